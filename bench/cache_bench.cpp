@@ -0,0 +1,570 @@
+//benchmark of the cache reads the natives do while the network thread
+//replays a notify flood, built without the SA-MP SDK:
+//	cmake -S bench -B build-bench && cmake --build build-bench
+//	build-bench/tsc-cache-bench [milliseconds per mode]
+//the channel- and clientlist of bench/corpus/channel_tree.txt fill the cache, the
+//notifies of mass_join.txt and channel_tree.txt are replayed as fast as possible;
+//"mutex (legacy)" reads the cache under its mutex like the getters used to
+//(a validity check and the actual read, locking twice), the snapshot modes read
+//the published CacheSnapshot: "snapshot (per read)" publishes one after every
+//read like the cache used to, "snapshot" at most one per CServer::PublishInterval;
+//every few rounds the network thread also merges the whole list result again,
+//like a resync does
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include "CResultRow.hpp"
+#include "CSchemaRow.hpp"
+#include "CServer.hpp"
+#include "CUtils.hpp"
+
+using std::string;
+using std::vector;
+typedef std::chrono::steady_clock Clock_t;
+
+
+//keeps results from being optimized away
+static size_t Sink = 0;
+
+//a notify flood is read in chunks
+static const size_t LinesPerRead = 64;
+//the list results are merged again after this many replays of the flood
+static const unsigned int RoundsPerResync = 20;
+//reads taking longer than this most likely waited for the network thread
+static const unsigned int StallNanoseconds = 10 * 1000;
+
+
+static bool ReadFile(const string &path, string &dest)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (file.is_open() == false)
+		return false;
+
+	std::ostringstream data;
+	data << file.rdbuf();
+	dest = data.str();
+	return true;
+}
+
+static void SplitLines(const string &data, vector<boost::string_ref> &lines)
+{
+	boost::string_ref remaining(data);
+	while (remaining.empty() == false)
+	{
+		size_t line_end = remaining.find('\r');
+		boost::string_ref line = remaining.substr(0, line_end);
+		remaining.remove_prefix(line_end != boost::string_ref::npos ? line_end + 1 : remaining.length());
+		while (line.empty() == false && line.back() == '\n')
+			line.remove_suffix(1);
+		if (line.empty() == false)
+			lines.push_back(line);
+	}
+}
+
+//calls "func" with every '|' separated row of "line"
+template<typename F>
+static void ForEachRow(boost::string_ref line, F &&func)
+{
+	while (line.empty() == false)
+	{
+		const size_t end = line.find('|');
+		func(line.substr(0, end));
+		line.remove_prefix(end != boost::string_ref::npos ? end + 1 : line.length());
+	}
+}
+
+
+//the part of CServer the network thread works on: the cache, its indexes
+//and the notify handlers, without callbacks
+class CBenchCache
+{
+private: //variables
+	ChannelTable m_Channels;
+	CSharedPart<ChannelNameIndex_t> m_ChannelNameIndex;
+	ClientTable m_Clients;
+	CSharedPart<ClientIndex_t> m_ClientUidIndex;
+	CSharedPart<ChannelClients_t> m_ChannelClients;
+
+	boost::mutex m_Mtx;
+	CacheSnapshot_t m_Snapshot;
+	unsigned int m_Version = 0;
+	bool m_IsDirty = false;
+
+public:
+	unsigned long long PublishedSnapshots = 0;
+
+
+public: //constructor / deconstructor
+	CBenchCache() :
+		m_Snapshot(CopySnapshot())
+	{ }
+
+
+public: //network thread
+	void MergeLists(const vector<boost::string_ref> &channel_rows,
+		const vector<boost::string_ref> &client_rows)
+	{
+		boost::lock_guard<boost::mutex> mtx_guard(m_Mtx);
+		for (auto &r : channel_rows)
+		{
+			const CSchemaRow<ChannelListRow> fields(r);
+			Channel::Id_t cid = Channel::Invalid;
+			fields.Get(ChannelListRow::cid, cid);
+
+			Channel channel;
+			fields.Get(ChannelListRow::pid, channel.ParentId);
+			fields.Get(ChannelListRow::channel_order, channel.OrderId);
+			fields.Get(ChannelListRow::channel_name, channel.Name);
+			CUtils::Get()->UnEscapeString(channel.Name);
+			fields.Get(ChannelListRow::channel_maxclients, channel.MaxClients);
+			fields.Get(ChannelListRow::channel_needed_talk_power, channel.RequiredTalkPower);
+
+			RemoveChannel(cid);
+			if (m_Channels.Insert(cid, channel))
+				m_ChannelNameIndex.Edit().emplace(channel.Name, cid);
+		}
+		for (auto &r : client_rows)
+			AddClient(CSchemaRow<ClientListRow>(r));
+		m_IsDirty = true;
+	}
+
+	void OnNotify(boost::string_ref line)
+	{
+		const size_t verb_end = line.find(' ');
+		const boost::string_ref verb = line.substr(0, verb_end);
+		line.remove_prefix(verb_end != boost::string_ref::npos ? verb_end + 1 : line.length());
+
+		boost::lock_guard<boost::mutex> mtx_guard(m_Mtx);
+		std::unique_ptr<CResultRow> first_row;
+		ForEachRow(line, [&](boost::string_ref entry)
+		{
+			CResultRow row(entry, first_row.get());
+			if (verb == "notifycliententerview")
+				OnClientEnterView(CSchemaRow<ClientEnterViewNotify>(row));
+			else if (verb == "notifyclientleftview")
+				OnClientLeftView(CSchemaRow<ClientLeftViewNotify>(row));
+			else if (verb == "notifyclientmoved")
+				OnClientMoved(CSchemaRow<ClientMovedNotify>(row));
+			else if (verb == "notifychanneledited")
+				OnChannelEdited(CSchemaRow<ChannelEditedNotify>(row));
+
+			if (first_row == nullptr)
+				first_row.reset(new CResultRow(entry));
+		});
+		++m_Version;
+		m_IsDirty = true;
+	}
+
+	//the same copy CServer::PublishSnapshot makes
+	void Publish()
+	{
+		if (m_IsDirty == false)
+			return;
+
+		boost::lock_guard<boost::mutex> mtx_guard(m_Mtx);
+		shared_ptr<CacheSnapshot> snapshot = CopySnapshot();
+		snapshot->Version = m_Version;
+		m_IsDirty = false;
+		std::atomic_store(&m_Snapshot, CacheSnapshot_t(std::move(snapshot)));
+		++PublishedSnapshots;
+	}
+
+
+public: //game thread, the way the getters used to read
+	bool IsValidClientLocked(Client::Id_t clid)
+	{
+		boost::lock_guard<boost::mutex> mtx_guard(m_Mtx);
+		return m_Clients.Has(clid);
+	}
+	bool IsValidChannelLocked(Channel::Id_t cid)
+	{
+		boost::lock_guard<boost::mutex> mtx_guard(m_Mtx);
+		return m_Channels.Has(cid);
+	}
+	Channel::Id_t GetClientChannelIdLocked(Client::Id_t clid)
+	{
+		if (IsValidClientLocked(clid) == false)
+			return Channel::Invalid;
+
+		boost::lock_guard<boost::mutex> mtx_guard(m_Mtx);
+		const ClientTable::Slot_t slot = m_Clients.Find(clid);
+		return slot != ClientTable::NoSlot ? m_Clients.CurrentChannel[slot] : Channel::Id_t(Channel::Invalid);
+	}
+	size_t GetChannelNameLengthLocked(Channel::Id_t cid)
+	{
+		if (IsValidChannelLocked(cid) == false)
+			return 0;
+
+		boost::lock_guard<boost::mutex> mtx_guard(m_Mtx);
+		const ChannelTable::Slot_t slot = m_Channels.Find(cid);
+		return slot != ChannelTable::NoSlot ? string(m_Channels.GetName(slot)).length() : 0;
+	}
+
+public: //game thread, the way the getters read now
+	Channel::Id_t GetClientChannelId(Client::Id_t clid)
+	{
+		CacheSnapshot_t snapshot = std::atomic_load(&m_Snapshot);
+		const ClientTable::Slot_t slot = snapshot->Clients.Find(clid);
+		return slot != ClientTable::NoSlot ? snapshot->Clients.CurrentChannel[slot] : Channel::Id_t(Channel::Invalid);
+	}
+	size_t GetChannelNameLength(Channel::Id_t cid)
+	{
+		CacheSnapshot_t snapshot = std::atomic_load(&m_Snapshot);
+		const ChannelTable::Slot_t slot = snapshot->Channels.Find(cid);
+		return slot != ChannelTable::NoSlot ? string(snapshot->Channels.GetName(slot)).length() : 0;
+	}
+
+
+private: //functions
+	//m_Mtx has to be locked, unless nothing else uses the instance yet
+	shared_ptr<CacheSnapshot> CopySnapshot()
+	{
+		shared_ptr<CacheSnapshot> snapshot = std::make_shared<CacheSnapshot>();
+		snapshot->Channels = m_Channels;
+		snapshot->ChannelNameIndex = m_ChannelNameIndex.Share();
+		snapshot->Clients = m_Clients;
+		snapshot->ClientUidIndex = m_ClientUidIndex.Share();
+		snapshot->ChannelClients = m_ChannelClients.Share();
+		return snapshot;
+	}
+
+	void RemoveChannel(Channel::Id_t cid)
+	{
+		const ChannelTable::Slot_t slot = m_Channels.Find(cid);
+		if (slot == ChannelTable::NoSlot)
+			return;
+
+		ChannelNameIndex_t &name_index = m_ChannelNameIndex.Edit();
+		auto range = name_index.equal_range(m_Channels.GetName(slot));
+		for (auto i = range.first; i != range.second; ++i)
+		{
+			if (i->second == cid)
+			{
+				name_index.erase(i);
+				break;
+			}
+		}
+		m_Channels.Erase(cid);
+	}
+
+	void AddClient(const CSchemaRow<ClientListRow> &fields)
+	{
+		Client::Id_t clid = Client::Invalid;
+		Client client;
+		fields.Get(ClientListRow::clid, clid);
+		fields.Get(ClientListRow::cid, client.CurrentChannel);
+		fields.Get(ClientListRow::client_database_id, client.DatabaseId);
+		fields.Get(ClientListRow::client_unique_identifier, client.Uid);
+		fields.Get(ClientListRow::connection_client_ip, client.IpAddress);
+		InsertClient(clid, client);
+	}
+	void InsertClient(Client::Id_t clid, const Client &client)
+	{
+		RemoveClient(clid);
+		if (m_Clients.Insert(clid, client) == false)
+			return;
+
+		m_ClientUidIndex.Edit().emplace(client.Uid, clid);
+		m_ChannelClients.Edit()[client.CurrentChannel].push_back(clid);
+	}
+	void RemoveClient(Client::Id_t clid)
+	{
+		const ClientTable::Slot_t slot = m_Clients.Find(clid);
+		if (slot == ClientTable::NoSlot)
+			return;
+
+		ClientIndex_t &uid_index = m_ClientUidIndex.Edit();
+		auto range = uid_index.equal_range(m_Clients.GetUid(slot));
+		for (auto i = range.first; i != range.second; ++i)
+		{
+			if (i->second == clid)
+			{
+				uid_index.erase(i);
+				break;
+			}
+		}
+		vector<Client::Id_t> &members = m_ChannelClients.Edit()[m_Clients.CurrentChannel[slot]];
+		members.erase(std::remove(members.begin(), members.end(), clid), members.end());
+		m_Clients.Erase(clid);
+	}
+
+	void OnClientEnterView(const CSchemaRow<ClientEnterViewNotify> &fields)
+	{
+		Client::Id_t clid = Client::Invalid;
+		fields.Get(ClientEnterViewNotify::clid, clid);
+
+		Client client;
+		fields.Get(ClientEnterViewNotify::ctid, client.CurrentChannel);
+		fields.Get(ClientEnterViewNotify::client_database_id, client.DatabaseId);
+		fields.Get(ClientEnterViewNotify::client_unique_identifier, client.Uid);
+		InsertClient(clid, client);
+	}
+	void OnClientLeftView(const CSchemaRow<ClientLeftViewNotify> &fields)
+	{
+		Client::Id_t clid = Client::Invalid;
+		fields.Get(ClientLeftViewNotify::clid, clid);
+		RemoveClient(clid);
+	}
+	void OnClientMoved(const CSchemaRow<ClientMovedNotify> &fields)
+	{
+		Client::Id_t clid = Client::Invalid;
+		Channel::Id_t cid = Channel::Invalid;
+		fields.Get(ClientMovedNotify::clid, clid);
+		fields.Get(ClientMovedNotify::ctid, cid);
+
+		const ClientTable::Slot_t slot = m_Clients.Find(clid);
+		if (slot == ClientTable::NoSlot)
+			return;
+
+		Channel::Id_t &current_channel = m_Clients.CurrentChannel[slot];
+		ChannelClients_t &channel_clients = m_ChannelClients.Edit();
+		vector<Client::Id_t> &members = channel_clients[current_channel];
+		members.erase(std::remove(members.begin(), members.end(), clid), members.end());
+		current_channel = cid;
+		channel_clients[cid].push_back(clid);
+	}
+	void OnChannelEdited(const CSchemaRow<ChannelEditedNotify> &fields)
+	{
+		Channel::Id_t cid = Channel::Invalid;
+		fields.Get(ChannelEditedNotify::cid, cid);
+
+		const ChannelTable::Slot_t slot = m_Channels.Find(cid);
+		if (slot == ChannelTable::NoSlot)
+			return;
+
+		fields.Get(ChannelEditedNotify::channel_order, m_Channels.OrderId[slot]);
+		fields.Get(ChannelEditedNotify::channel_maxclients, m_Channels.MaxClients[slot]);
+		fields.Get(ChannelEditedNotify::channel_needed_talk_power, m_Channels.RequiredTalkPower[slot]);
+	}
+};
+
+struct Corpus
+{
+	string ChannelTree, MassJoin;
+	vector<boost::string_ref>
+		ChannelRows,
+		ClientRows,
+		Notifies;
+	Client::Id_t MaxClientId = 0;
+	Channel::Id_t MaxChannelId = 0;
+};
+
+static bool LoadCorpus(Corpus &corpus)
+{
+	const string dir(TSC_BENCH_CORPUS_DIR);
+	if (ReadFile(dir + "/channel_tree.txt", corpus.ChannelTree) == false
+		|| ReadFile(dir + "/mass_join.txt", corpus.MassJoin) == false)
+		return false;
+
+	vector<boost::string_ref> lines;
+	SplitLines(corpus.ChannelTree, lines);
+	SplitLines(corpus.MassJoin, lines);
+	for (auto &l : lines)
+	{
+		if (l.starts_with("notify"))
+		{
+			corpus.Notifies.push_back(l);
+		}
+		else if (l.starts_with("cid=") && l.find(" pid=") != boost::string_ref::npos)
+		{
+			ForEachRow(l, [&](boost::string_ref r)
+			{
+				corpus.ChannelRows.push_back(r);
+				Channel::Id_t cid = 0;
+				CSchemaRow<ChannelListRow>(r).Get(ChannelListRow::cid, cid);
+				corpus.MaxChannelId = std::max(corpus.MaxChannelId, cid);
+			});
+		}
+		else if (l.starts_with("clid=") && l.find(" client_unique_identifier=") != boost::string_ref::npos)
+		{
+			ForEachRow(l, [&](boost::string_ref r)
+			{
+				corpus.ClientRows.push_back(r);
+			});
+		}
+	}
+
+	for (auto &n : corpus.Notifies)
+	{
+		Client::Id_t clid = 0;
+		CResultRow(n).Get("clid", clid);
+		corpus.MaxClientId = std::max(corpus.MaxClientId, clid);
+	}
+	for (auto &r : corpus.ClientRows)
+	{
+		Client::Id_t clid = 0;
+		CSchemaRow<ClientListRow>(r).Get(ClientListRow::clid, clid);
+		corpus.MaxClientId = std::max(corpus.MaxClientId, clid);
+	}
+	return corpus.ChannelRows.empty() == false && corpus.Notifies.empty() == false;
+}
+
+
+struct ModeResult
+{
+	vector<unsigned int> ReadNanoseconds;
+	unsigned long long
+		Notifies = 0,
+		Nanoseconds = 0,
+		Snapshots = 0;
+};
+
+enum class EReadMode
+{
+	MUTEX,
+	SNAPSHOT_PER_READ,
+	SNAPSHOT
+};
+
+static void RunMode(const Corpus &corpus, EReadMode mode,
+	std::chrono::milliseconds duration, ModeResult &result)
+{
+	const bool use_snapshot = mode != EReadMode::MUTEX;
+
+	CBenchCache cache;
+	cache.MergeLists(corpus.ChannelRows, corpus.ClientRows);
+	cache.Publish();
+
+	boost::atomic<bool> stop(false);
+	boost::atomic<unsigned long long> applied(0);
+	boost::thread io_thread([&]()
+	{
+		//what CServer::MarkCacheChanged schedules at the end of a read
+		Clock_t::time_point last_publish = Clock_t::now();
+		auto end_of_read = [&]()
+		{
+			if (mode == EReadMode::SNAPSHOT_PER_READ)
+			{
+				cache.Publish();
+			}
+			else if (mode == EReadMode::SNAPSHOT)
+			{
+				const Clock_t::time_point now = Clock_t::now();
+				if (now - last_publish >= std::chrono::milliseconds(CServer::PublishInterval))
+				{
+					cache.Publish();
+					last_publish = now;
+				}
+			}
+		};
+
+		unsigned int round = 0;
+		while (stop == false)
+		{
+			size_t in_read = 0;
+			for (auto &n : corpus.Notifies)
+			{
+				cache.OnNotify(n);
+				if (++in_read == LinesPerRead)
+				{
+					end_of_read();
+					in_read = 0;
+				}
+			}
+			if (++round % RoundsPerResync == 0)
+				cache.MergeLists(corpus.ChannelRows, corpus.ClientRows);
+			end_of_read();
+			applied += corpus.Notifies.size();
+		}
+	});
+
+	result.ReadNanoseconds.reserve(8 * 1000 * 1000);
+	const Clock_t::time_point start = Clock_t::now();
+	Clock_t::time_point now = start;
+	Client::Id_t clid = 0;
+	while (now - start < duration)
+	{
+		//what a gamemode does per player: its client's channel and the channel's name
+		clid = clid < corpus.MaxClientId ? clid + 1 : 1;
+		const Clock_t::time_point read_start = Clock_t::now();
+		if (use_snapshot)
+		{
+			Channel::Id_t cid = cache.GetClientChannelId(clid);
+			Sink += cache.GetChannelNameLength(cid);
+		}
+		else
+		{
+			Channel::Id_t cid = cache.GetClientChannelIdLocked(clid);
+			Sink += cache.GetChannelNameLengthLocked(cid);
+		}
+		now = Clock_t::now();
+		if (result.ReadNanoseconds.size() != result.ReadNanoseconds.capacity())
+			result.ReadNanoseconds.push_back(static_cast<unsigned int>(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(now - read_start).count()));
+	}
+
+	stop = true;
+	io_thread.join();
+	result.Nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock_t::now() - start).count();
+	result.Notifies = applied;
+	result.Snapshots = cache.PublishedSnapshots;
+}
+
+static unsigned int Percentile(vector<unsigned int> &values, double percentile)
+{
+	if (values.empty())
+		return 0;
+
+	const size_t idx = std::min(values.size() - 1,
+		static_cast<size_t>(percentile / 100.0 * values.size()));
+	std::nth_element(values.begin(), values.begin() + idx, values.end());
+	return values[idx];
+}
+
+static void PrintMode(const char *name, ModeResult &result)
+{
+	const double seconds = result.Nanoseconds / 1e9;
+	const size_t stalls = std::count_if(result.ReadNanoseconds.begin(), result.ReadNanoseconds.end(),
+		[](unsigned int ns) { return ns > StallNanoseconds; });
+	std::printf("  %-20s %11.0f reads/s %8u stalls  p50 %6u ns  p99 %7u ns  p99.9 %8u ns  max %9u ns"
+		"  | %9.0f notifies/s %7llu snapshots\n",
+		name, result.ReadNanoseconds.size() / seconds, static_cast<unsigned int>(stalls),
+		Percentile(result.ReadNanoseconds, 50.0),
+		Percentile(result.ReadNanoseconds, 99.0),
+		Percentile(result.ReadNanoseconds, 99.9),
+		Percentile(result.ReadNanoseconds, 100.0),
+		result.Notifies / seconds, result.Snapshots);
+}
+
+
+int main(int argc, char *argv[])
+{
+	std::chrono::milliseconds duration(1000);
+	if (argc > 1)
+		duration = std::chrono::milliseconds(std::atoi(argv[1]));
+
+	Corpus corpus;
+	if (LoadCorpus(corpus) == false)
+	{
+		std::fprintf(stderr, "can't read the corpus in \"%s\"\n", TSC_BENCH_CORPUS_DIR);
+		return 1;
+	}
+
+	std::printf("cache reads during a notify flood: %u channels, %u clients, %u notifies per round\n",
+		static_cast<unsigned int>(corpus.ChannelRows.size()),
+		static_cast<unsigned int>(corpus.ClientRows.size()),
+		static_cast<unsigned int>(corpus.Notifies.size()));
+
+	ModeResult locked, snapshot_per_read, snapshot;
+	RunMode(corpus, EReadMode::MUTEX, duration, locked);
+	PrintMode("mutex (legacy)", locked);
+	RunMode(corpus, EReadMode::SNAPSHOT_PER_READ, duration, snapshot_per_read);
+	PrintMode("snapshot (per read)", snapshot_per_read);
+	RunMode(corpus, EReadMode::SNAPSHOT, duration, snapshot);
+	PrintMode("snapshot", snapshot);
+
+	return Sink == 42 ? 1 : 0;
+}
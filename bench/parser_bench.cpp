@@ -0,0 +1,824 @@
+//benchmark of the ServerQuery read and write path on recorded traffic,
+//built without the SA-MP SDK:
+//	cmake -S bench -B build-bench && cmake --build build-bench
+//	build-bench/tsc-parser-bench [transcript files]
+//without arguments the transcripts in bench/corpus are used; every stage reports
+//lines/sec, ns/line and heap allocations/line, "legacy" stages run the code the
+//plugin used before, for comparison
+//the pipelining stage sends commands to a local stand-in for the ServerQuery
+//interface, with up to "depth" of them waiting for their response
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <deque>
+#include <algorithm>
+#include <functional>
+#include <boost/atomic.hpp>
+#include <boost/regex.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/asio.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include "CResultRow.hpp"
+#include "CSchemaRow.hpp"
+#include "CServer.hpp"
+#include "CUtils.hpp"
+#include "format.h"
+
+using std::string;
+using std::vector;
+namespace asio = boost::asio;
+using asio::ip::tcp;
+typedef std::chrono::steady_clock Clock_t;
+
+
+static boost::atomic<unsigned long long> AllocationCount(0);
+
+void *operator new(size_t size)
+{
+	AllocationCount.fetch_add(1, boost::memory_order_relaxed);
+	if (void *ptr = std::malloc(size != 0 ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+
+//keeps results from being optimized away
+static size_t Sink = 0;
+
+struct Transcript
+{
+	string Name;
+	string Data;
+	vector<boost::string_ref> Lines; //without "\n\r"
+	vector<boost::string_ref> Notifies;
+	vector<boost::string_ref> ResultLines; //neither notify nor error
+	vector<string> EscapedValues; //nicknames, channel names, messages, ...
+};
+
+struct StageResult
+{
+	unsigned long long
+		Items = 0,
+		Nanoseconds = 0,
+		Allocations = 0;
+};
+
+//runs "stage" until at least "min_time" passed, "stage" returns the number of lines it handled
+static StageResult RunStage(std::function<size_t()> stage,
+	std::chrono::milliseconds min_time = std::chrono::milliseconds(300))
+{
+	stage(); //warm up
+
+	StageResult result;
+	const Clock_t::time_point start = Clock_t::now();
+	const unsigned long long start_allocs = AllocationCount.load();
+	Clock_t::time_point now;
+	do
+	{
+		result.Items += stage();
+		now = Clock_t::now();
+	} while (now - start < min_time);
+
+	result.Allocations = AllocationCount.load() - start_allocs;
+	result.Nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+	return result;
+}
+
+static void PrintStage(const char *name, const StageResult &result)
+{
+	if (result.Items == 0)
+	{
+		std::printf("  %-18s %14s\n", name, "(no lines)");
+		return;
+	}
+
+	const double
+		ns_per_item = static_cast<double>(result.Nanoseconds) / result.Items,
+		allocs_per_item = static_cast<double>(result.Allocations) / result.Items;
+	std::printf("  %-18s %14.0f lines/s %10.1f ns/line %8.2f allocs/line\n",
+		name, 1e9 / ns_per_item, ns_per_item, allocs_per_item);
+}
+
+
+//stage: line framing, the same chunked scan for '\r' CQuerySession::OnRead does
+static size_t FrameLines(const string &data)
+{
+	static const size_t chunk_size = 16384;
+	static vector<char> buffer;
+	size_t
+		read_begin = 0,
+		read_end = 0,
+		read_scanned = 0,
+		data_pos = 0,
+		lines = 0;
+
+	while (data_pos != data.length())
+	{
+		if (read_begin == read_end)
+			read_begin = read_end = read_scanned = 0;
+		if (buffer.size() - read_end < chunk_size)
+		{
+			if (read_begin != 0)
+			{
+				std::memmove(buffer.data(), buffer.data() + read_begin, read_end - read_begin);
+				read_end -= read_begin;
+				read_scanned -= read_begin;
+				read_begin = 0;
+			}
+			if (buffer.size() - read_end < chunk_size)
+				buffer.resize(std::max(buffer.size() * 2, read_end + chunk_size));
+		}
+
+		const size_t bytes_read = std::min(chunk_size, data.length() - data_pos);
+		std::memcpy(buffer.data() + read_end, data.data() + data_pos, bytes_read);
+		data_pos += bytes_read;
+		read_end += bytes_read;
+
+		while (read_scanned != read_end)
+		{
+			const char *line_end = static_cast<const char *>(
+				std::memchr(buffer.data() + read_scanned, '\r', read_end - read_scanned));
+			if (line_end == nullptr)
+			{
+				read_scanned = read_end;
+				break;
+			}
+			Sink += (line_end - buffer.data()) - read_begin;
+			read_begin = read_scanned = (line_end - buffer.data()) + 1;
+			++lines;
+		}
+	}
+	return lines;
+}
+
+
+//stage: result rows split on '|' into one arena and tokenized, like a command callback gets them
+static size_t SplitResultRows(const vector<boost::string_ref> &lines)
+{
+	static string arena;
+	static vector<size_t> row_ends;
+	arena.clear();
+	row_ends.clear();
+
+	for (boost::string_ref line : lines)
+	{
+		size_t delim_pos = 0;
+		do
+		{
+			delim_pos = line.find('|');
+			const boost::string_ref row = line.substr(0, delim_pos);
+			arena.append(row.data(), row.length());
+			row_ends.push_back(arena.length());
+			if (delim_pos != boost::string_ref::npos)
+				line.remove_prefix(delim_pos + 1);
+		} while (delim_pos != boost::string_ref::npos);
+	}
+
+	size_t row_begin = 0;
+	for (size_t row_end : row_ends)
+	{
+		const CResultRow row(boost::string_ref(arena.data() + row_begin, row_end - row_begin));
+		Sink += row.GetFields().size();
+		row_begin = row_end;
+	}
+	return lines.size();
+}
+
+
+//stage: notify dispatch by verb with schema parsing, what CNetwork::OnNotify
+//and the CServer handlers do without touching the cache
+class CNotifyDispatcher
+{
+private:
+	struct VerbHash
+	{
+		size_t operator()(boost::string_ref verb) const
+		{
+			return boost::hash_range(verb.begin(), verb.end());
+		}
+	};
+	struct VerbEqual
+	{
+		bool operator()(boost::string_ref lhs, boost::string_ref rhs) const
+		{
+			return lhs == rhs;
+		}
+	};
+	typedef std::function<void(const CResultRow &row)> Handler_t;
+	boost::unordered_map<string, Handler_t, VerbHash, VerbEqual> m_Handlers;
+	//the same field buffers CNetwork::OnNotify reuses
+	vector<CResultRow::Field> m_Fields[2];
+
+	template<typename Schema>
+	static void ReadString(const CSchemaRow<Schema> &fields, typename Schema::Field field)
+	{
+		string value;
+		fields.Get(field, value);
+		CUtils::Get()->UnEscapeString(value);
+		Sink += value.length();
+	}
+	template<typename Schema>
+	static void ReadInt(const CSchemaRow<Schema> &fields, typename Schema::Field field)
+	{
+		int value = 0;
+		fields.Get(field, value);
+		Sink += value;
+	}
+
+public:
+	CNotifyDispatcher()
+	{
+		m_Handlers["notifycliententerview"] = [](const CResultRow &row)
+		{
+			typedef ClientEnterViewNotify S;
+			const CSchemaRow<S> fields(row);
+			ReadInt(fields, S::cfid);
+			ReadInt(fields, S::reasonid);
+			ReadInt(fields, S::ctid);
+			ReadInt(fields, S::clid);
+			ReadString(fields, S::client_unique_identifier);
+			ReadString(fields, S::client_nickname);
+			ReadInt(fields, S::client_database_id);
+			ReadInt(fields, S::client_type);
+		};
+		m_Handlers["notifyclientleftview"] = [](const CResultRow &row)
+		{
+			typedef ClientLeftViewNotify S;
+			const CSchemaRow<S> fields(row);
+			ReadInt(fields, S::ctid);
+			ReadInt(fields, S::reasonid);
+			ReadString(fields, S::reasonmsg);
+			ReadInt(fields, S::clid);
+		};
+		m_Handlers["notifyclientmoved"] = [](const CResultRow &row)
+		{
+			typedef ClientMovedNotify S;
+			const CSchemaRow<S> fields(row);
+			ReadInt(fields, S::ctid);
+			ReadInt(fields, S::invokerid);
+			ReadInt(fields, S::clid);
+		};
+		m_Handlers["notifytextmessage"] = [](const CResultRow &row)
+		{
+			typedef TextMessageNotify S;
+			const CSchemaRow<S> fields(row);
+			ReadInt(fields, S::targetmode);
+			ReadString(fields, S::msg);
+			ReadInt(fields, S::target);
+			ReadInt(fields, S::invokerid);
+			ReadString(fields, S::invokername);
+		};
+		m_Handlers["notifychanneledited"] = [](const CResultRow &row)
+		{
+			typedef ChannelEditedNotify S;
+			const CSchemaRow<S> fields(row);
+			ReadInt(fields, S::cid);
+			ReadInt(fields, S::reasonid);
+			if (fields.Has(S::channel_name))
+				ReadString(fields, S::channel_name);
+			ReadInt(fields, S::channel_order);
+			ReadInt(fields, S::channel_flag_password);
+			ReadInt(fields, S::channel_maxclients);
+		};
+		m_Handlers["notifychannelpasswordchanged"] = [](const CResultRow &row)
+		{
+			typedef ChannelIdNotify S;
+			ReadInt(CSchemaRow<S>(row), S::cid);
+		};
+	}
+
+	void Dispatch(boost::string_ref notify)
+	{
+		const boost::string_ref verb = notify.substr(0, notify.find_first_of(" \n\r"));
+		auto it = m_Handlers.find(verb, VerbHash(), VerbEqual());
+		if (it == m_Handlers.end())
+			return;
+
+		boost::string_ref entries(notify);
+		entries.remove_prefix(verb.length());
+
+		size_t delim_pos = entries.find('|');
+		const CResultRow first_row(entries.substr(0, delim_pos), m_Fields[0]);
+		it->second(first_row);
+		while (delim_pos != boost::string_ref::npos)
+		{
+			entries.remove_prefix(delim_pos + 1);
+			delim_pos = entries.find('|');
+			it->second(CResultRow(entries.substr(0, delim_pos), m_Fields[1], &first_row));
+		}
+	}
+};
+
+
+//legacy stage: the regex list notifies were matched against before
+class CLegacyRegexDispatcher
+{
+private:
+	vector<boost::regex> m_Events;
+
+public:
+	CLegacyRegexDispatcher()
+	{
+		const char *events[] = {
+			"notifychannelcreated cid=([0-9]+) cpid=([0-9]+) channel_name=([^ ]+)(.+)invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ \n\r]+",
+			"notifychanneldeleted .+ cid=([0-9]+)",
+			"notifychanneledited cid=([0-9]+) reasonid=10 invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ ]+ channel_order=([0-9]+)",
+			"notifychannelmoved cid=([0-9]+) cpid=([0-9]+) order=([0-9]+) reasonid=1 invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ \n\r]+",
+			"notifychanneledited cid=([0-9]+) reasonid=10 invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ ]+ channel_name=([^ \n\r]+)",
+			"notifychanneledited cid=([0-9]+) reasonid=10 invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ ]+ channel_flag_password=([01])",
+			"notifychannelpasswordchanged cid=([0-9]+)",
+			"notifychanneledited cid=([0-9]+) reasonid=10 invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ ]+ (?:channel_flag_(permanent|semi_permanent)=([01]))(?: channel_flag_(permanent|semi_permanent)=([01]))?.*",
+			"notifychanneledited cid=([0-9]+) reasonid=10 invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ ]+ channel_flag_default=1.*",
+			"notifychanneledited cid=([0-9]+) reasonid=10 invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ ]+ channel_maxclients=([-0-9]+).*",
+			"notifychanneledited cid=([0-9]+) reasonid=10 invokerid=[0-9]+ .+ channel_needed_talk_power=([-0-9]+)",
+			"notifycliententerview cfid=0 ctid=([0-9]+) reasonid=0 clid=([0-9]+) client_unique_identifier=([^ ]+) client_nickname=([^ ]+) .+ client_database_id=([0-9]+) .+ client_type=([01]).*",
+			"notifyclientleftview cfid=[0-9]+ ctid=0(?: reasonid=([0-9]+).* reasonmsg(?:=([^ ]+))?.*)? clid=([0-9]+).*",
+			"notifyclientmoved ctid=([0-9]+) reasonid=([0-9]+)(?: invokerid=([0-9]+))?.* (clid=.*)",
+			"notifytextmessage targetmode=3 msg=([^ ]+) invokerid=([0-9]+) invokername=([^ ]+).*",
+			"notifytextmessage targetmode=1 msg=([^ ]+) target=([0-9]+) invokerid=([0-9]+) invokername=([^ ]+).*"
+		};
+		for (const char *e : events)
+			m_Events.push_back(boost::regex(e));
+	}
+
+	void Dispatch(boost::string_ref notify)
+	{
+		//the line used to be copied for the duplicate check first
+		const string notify_data(notify.data(), notify.length());
+		boost::smatch result;
+		for (auto &rx : m_Events)
+		{
+			if (boost::regex_search(notify_data, result, rx))
+			{
+				for (size_t i = 1; i < result.size(); ++i)
+					Sink += result[i].str().length();
+				break;
+			}
+		}
+	}
+};
+
+
+//legacy stage: table-driven find/replace unescaping
+static void LegacyUnEscapeString(string &str)
+{
+	static const char char_escape_table[][2][5] =
+	{
+		{ " ", "\\s" }, { "\\", "\\\\" }, { "/", "\\/" }, { "|", "\\p" },
+		{ "\a", "\\a" }, { "\b", "\\b" }, { "\f", "\\f" }, { "\n", "\\n" },
+		{ "\r", "\\r" }, { "\t", "\\t" }, { "\v", "\\v" }
+	};
+
+	if (str.length() >= 2)
+	{
+		for (size_t ci = 0; ci < (sizeof(char_escape_table) / sizeof(char_escape_table[0])); ++ci)
+		{
+			size_t find_pos = 0;
+			while ((find_pos = str.find(char_escape_table[ci][1])) != string::npos)
+				str.replace(find_pos, 2, char_escape_table[ci][0]);
+		}
+	}
+}
+
+
+//write path: commands written to a local socket pair, either gathered into one
+//write per batch like CQuerySession::StartWrite or written one by one like before;
+//returns the number of writes needed for "num_commands" commands
+static size_t MeasureWrites(size_t num_commands, bool gather, unsigned long long &nanoseconds)
+{
+	asio::io_service io_service;
+	asio::local::stream_protocol::socket
+		writer(io_service),
+		reader(io_service);
+	asio::local::connect_pair(writer, reader);
+
+	boost::mutex write_mutex;
+	vector<string>
+		write_pending,
+		write_in_flight;
+	bool is_writing = false;
+	size_t
+		num_writes = 0,
+		bytes_written = 0;
+
+	std::function<void()> start_write = [&]()
+	{
+		boost::lock_guard<boost::mutex> lock_guard(write_mutex);
+		if (write_pending.empty())
+		{
+			is_writing = false;
+			return;
+		}
+
+		write_in_flight.swap(write_pending);
+		vector<asio::const_buffer> buffers;
+		for (auto &b : write_in_flight)
+			buffers.push_back(asio::buffer(b));
+
+		++num_writes;
+		asio::async_write(writer, buffers,
+			[&](const boost::system::error_code &, size_t bytes)
+		{
+			{
+				boost::lock_guard<boost::mutex> lock_guard(write_mutex);
+				write_in_flight.clear();
+				bytes_written += bytes;
+			}
+			start_write();
+		});
+	};
+
+	string cmd("clientpoke clid=42 msg=benchmark\\smessage\\snumber\\s00000\n");
+	const size_t total_bytes = cmd.length() * num_commands;
+
+	asio::io_service::work work(io_service);
+	boost::thread io_thread(boost::bind(&asio::io_service::run, &io_service));
+	boost::thread read_thread([&]()
+	{
+		vector<char> buffer(65536);
+		size_t bytes_read = 0;
+		boost::system::error_code error;
+		while (bytes_read < total_bytes && !error)
+			bytes_read += reader.read_some(asio::buffer(buffer), error);
+	});
+
+	const Clock_t::time_point start = Clock_t::now();
+	for (size_t c = 0; c != num_commands; ++c)
+	{
+		if (gather)
+		{
+			boost::lock_guard<boost::mutex> lock_guard(write_mutex);
+			write_pending.push_back(cmd);
+			if (is_writing == false)
+			{
+				is_writing = true;
+				io_service.post(start_write);
+			}
+		}
+		else
+		{
+			auto data = std::make_shared<string>(cmd);
+			io_service.post([&, data]()
+			{
+				++num_writes;
+				asio::async_write(writer, asio::buffer(*data),
+					[data](const boost::system::error_code &, size_t) { });
+			});
+		}
+	}
+	read_thread.join();
+	nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock_t::now() - start).count();
+
+	io_service.stop();
+	io_thread.join();
+	return num_writes;
+}
+
+
+//stand-in for the ServerQuery interface on 127.0.0.1: sends the welcome lines and
+//answers every command line with "error id=0 msg=ok", in order, "delay" after it
+//arrived, like a server that far away would
+class CLoopbackResponder
+{
+private: //variables
+	asio::io_service m_IoService;
+	tcp::acceptor m_Acceptor;
+	tcp::socket m_Socket;
+	asio::deadline_timer m_ResponseTimer;
+	boost::thread m_Thread;
+
+	const std::chrono::microseconds m_Delay;
+	asio::streambuf m_ReadBuffer;
+	std::deque<Clock_t::time_point> m_ResponseTimes;
+
+	string
+		m_WritePending,
+		m_WriteInFlight;
+	bool m_IsWriting = false;
+
+
+public: //constructor / deconstructor
+	explicit CLoopbackResponder(std::chrono::microseconds delay) :
+		m_Acceptor(m_IoService, tcp::endpoint(asio::ip::address_v4::loopback(), 0)),
+		m_Socket(m_IoService),
+		m_ResponseTimer(m_IoService),
+		m_Delay(delay)
+	{
+		m_Acceptor.async_accept(m_Socket, [this](const boost::system::error_code &error)
+		{
+			if (error)
+				return;
+
+			//the stand-in shouldn't hold back responses waiting for an ACK
+			m_Socket.set_option(tcp::no_delay(true));
+			Send("TS3\n\rWelcome to the TeamSpeak 3 ServerQuery interface.\n\r");
+			Read();
+		});
+		m_Thread = boost::thread(boost::bind(&asio::io_service::run, &m_IoService));
+	}
+	~CLoopbackResponder()
+	{
+		m_IoService.stop();
+		m_Thread.join();
+	}
+
+
+public: //functions
+	inline unsigned short GetPort() const
+	{
+		return m_Acceptor.local_endpoint().port();
+	}
+
+private: //functions
+	void Read()
+	{
+		asio::async_read_until(m_Socket, m_ReadBuffer, '\n',
+			[this](const boost::system::error_code &error, size_t bytes)
+		{
+			if (error)
+				return;
+
+			m_ReadBuffer.consume(bytes);
+			//the delay is the same for every command, so the times are in order
+			m_ResponseTimes.push_back(Clock_t::now() + m_Delay);
+			if (m_ResponseTimes.size() == 1)
+				StartResponseTimer();
+			Read();
+		});
+	}
+
+	void StartResponseTimer()
+	{
+		const auto wait_time = std::chrono::duration_cast<std::chrono::microseconds>(
+			m_ResponseTimes.front() - Clock_t::now());
+		m_ResponseTimer.expires_from_now(
+			boost::posix_time::microseconds(std::max<long long>(wait_time.count(), 0)));
+		m_ResponseTimer.async_wait([this](const boost::system::error_code &error)
+		{
+			if (error)
+				return;
+
+			const Clock_t::time_point now = Clock_t::now();
+			while (m_ResponseTimes.empty() == false && m_ResponseTimes.front() <= now)
+			{
+				m_ResponseTimes.pop_front();
+				m_WritePending.append("error id=0 msg=ok\n\r");
+			}
+			StartWrite();
+
+			if (m_ResponseTimes.empty() == false)
+				StartResponseTimer();
+		});
+	}
+
+	void Send(const char *data)
+	{
+		m_WritePending.append(data);
+		StartWrite();
+	}
+
+	void StartWrite()
+	{
+		if (m_IsWriting || m_WritePending.empty())
+			return;
+
+		m_IsWriting = true;
+		m_WriteInFlight.swap(m_WritePending);
+		m_WritePending.clear();
+		asio::async_write(m_Socket, asio::buffer(m_WriteInFlight),
+			[this](const boost::system::error_code &error, size_t)
+		{
+			m_IsWriting = false;
+			if (!error)
+				StartWrite();
+		});
+	}
+};
+
+//sends "num_commands" commands through a CLoopbackResponder like CQuerySession does:
+//up to "depth" commands are written before the first response arrived, every
+//response lets the next command go; returns the commands per second
+static double MeasurePipelining(unsigned int depth, std::chrono::microseconds delay,
+	size_t num_commands)
+{
+	CLoopbackResponder responder(delay);
+
+	asio::io_service io_service;
+	tcp::socket socket(io_service);
+	socket.connect(tcp::endpoint(asio::ip::address_v4::loopback(), responder.GetPort()));
+	socket.set_option(tcp::no_delay(true)); //like CQuerySession::OnConnect
+
+	asio::streambuf read_buffer;
+	for (int l = 0; l != 2; ++l) //welcome lines
+		read_buffer.consume(asio::read_until(socket, read_buffer, "\n\r"));
+
+	const string cmd("clientpoke clid=42 msg=benchmark\\smessage\n");
+	const Clock_t::time_point start = Clock_t::now();
+
+	size_t num_sent = std::min<size_t>(depth, num_commands);
+	string first_commands;
+	for (size_t c = 0; c != num_sent; ++c)
+		first_commands.append(cmd);
+	asio::write(socket, asio::buffer(first_commands));
+
+	for (size_t num_done = 0; num_done != num_commands; ++num_done)
+	{
+		read_buffer.consume(asio::read_until(socket, read_buffer, "\n\r"));
+		if (num_sent != num_commands)
+		{
+			asio::write(socket, asio::buffer(cmd));
+			++num_sent;
+		}
+	}
+
+	const double seconds = std::chrono::duration<double>(Clock_t::now() - start).count();
+	return num_commands / seconds;
+}
+
+
+static bool LoadTranscript(const string &path, Transcript &transcript)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (file.is_open() == false)
+		return false;
+
+	std::ostringstream data;
+	data << file.rdbuf();
+	transcript.Data = data.str();
+	transcript.Name = path.substr(path.find_last_of("/\\") + 1);
+
+	static const char *value_fields[] = {
+		"client_nickname=", "invokername=", "channel_name=", "msg=", "reasonmsg="
+	};
+
+	boost::string_ref remaining(transcript.Data);
+	while (remaining.empty() == false)
+	{
+		size_t line_end = remaining.find('\r');
+		boost::string_ref line = remaining.substr(0, line_end);
+		remaining.remove_prefix(line_end != boost::string_ref::npos ? line_end + 1 : remaining.length());
+		while (line.empty() == false && line.back() == '\n')
+			line.remove_suffix(1);
+		if (line.empty())
+			continue;
+
+		transcript.Lines.push_back(line);
+		if (line.starts_with("notify"))
+			transcript.Notifies.push_back(line);
+		else if (line.starts_with("error ") == false)
+			transcript.ResultLines.push_back(line);
+
+		for (const char *field : value_fields)
+		{
+			const boost::string_ref field_ref(field);
+			for (size_t pos = 0; pos < line.length(); ++pos)
+			{
+				const size_t found = line.substr(pos).find(field_ref);
+				if (found == boost::string_ref::npos)
+					break;
+				pos += found;
+				if (pos != 0 && line[pos - 1] != ' ' && line[pos - 1] != '|')
+					continue;
+
+				boost::string_ref value = line.substr(pos + field_ref.length());
+				value = value.substr(0, value.find_first_of(" |"));
+				transcript.EscapedValues.push_back(string(value.data(), value.length()));
+			}
+		}
+	}
+	return true;
+}
+
+static void RunTranscript(Transcript &transcript)
+{
+	std::printf("%s: %u lines, %u notifies, %u result lines, %u escaped values\n",
+		transcript.Name.c_str(),
+		static_cast<unsigned int>(transcript.Lines.size()),
+		static_cast<unsigned int>(transcript.Notifies.size()),
+		static_cast<unsigned int>(transcript.ResultLines.size()),
+		static_cast<unsigned int>(transcript.EscapedValues.size()));
+
+	PrintStage("frame", RunStage([&]()
+	{
+		return FrameLines(transcript.Data);
+	}));
+
+	PrintStage("result rows", RunStage([&]()
+	{
+		return SplitResultRows(transcript.ResultLines);
+	}));
+
+	CNotifyDispatcher dispatcher;
+	PrintStage("dispatch", RunStage([&]()
+	{
+		for (auto &n : transcript.Notifies)
+			dispatcher.Dispatch(n);
+		return transcript.Notifies.size();
+	}));
+
+	CLegacyRegexDispatcher legacy_dispatcher;
+	PrintStage("dispatch (legacy)", RunStage([&]()
+	{
+		for (auto &n : transcript.Notifies)
+			legacy_dispatcher.Dispatch(n);
+		return transcript.Notifies.size();
+	}));
+
+	//the values are unescaped in place, so every run starts from a fresh copy;
+	//assign() reuses the capacity, so the copy doesn't allocate after the first run
+	vector<string> values(transcript.EscapedValues.size());
+	auto reset_values = [&]()
+	{
+		for (size_t v = 0; v != values.size(); ++v)
+			values[v].assign(transcript.EscapedValues[v]);
+	};
+
+	PrintStage("unescape", RunStage([&]()
+	{
+		reset_values();
+		for (auto &v : values)
+			CUtils::Get()->UnEscapeString(v);
+		return values.size();
+	}));
+
+	PrintStage("unescape (legacy)", RunStage([&]()
+	{
+		reset_values();
+		for (auto &v : values)
+			LegacyUnEscapeString(v);
+		return values.size();
+	}));
+
+	PrintStage("escape", RunStage([&]()
+	{
+		for (auto &v : values)
+			Sink += fmt::format("sendtextmessage targetmode=3 target=1 msg={}", Escaped(v)).length();
+		return values.size();
+	}));
+	std::printf("\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+	vector<string> paths;
+	for (int a = 1; a < argc; ++a)
+		paths.push_back(argv[a]);
+	if (paths.empty())
+	{
+		for (const char *name : { "mass_join.txt", "channel_tree.txt", "chat_spam.txt" })
+			paths.push_back(string(TSC_BENCH_CORPUS_DIR) + "/" + name);
+	}
+
+	for (auto &path : paths)
+	{
+		Transcript transcript;
+		if (LoadTranscript(path, transcript) == false)
+		{
+			std::fprintf(stderr, "can't read transcript \"%s\"\n", path.c_str());
+			return 1;
+		}
+		RunTranscript(transcript);
+	}
+
+	std::printf("write path, 1000 commands:\n");
+	for (bool gather : { true, false })
+	{
+		unsigned long long nanoseconds = 0;
+		const size_t writes = MeasureWrites(1000, gather, nanoseconds);
+		std::printf("  %-18s %14u writes %10.1f us total\n",
+			gather ? "gathered" : "per command (legacy)",
+			static_cast<unsigned int>(writes), nanoseconds / 1000.0);
+	}
+
+	std::printf("pipelining, commands/s:\n");
+	std::printf("  %-18s %12s %12s %12s\n", "", "depth 1", "depth 4", "depth 16");
+	for (unsigned int delay_us : { 0, 1000 })
+	{
+		//fewer commands with a delay, depth 1 needs a round trip for every one
+		const size_t num_commands = delay_us == 0 ? 20000 : 1000;
+		const string name = delay_us == 0 ? string("no delay") : fmt::format("{} us round trip", delay_us);
+		std::printf("  %-18s", name.c_str());
+		for (unsigned int depth : { 1, 4, 16 })
+			std::printf(" %12.0f", MeasurePipelining(depth, std::chrono::microseconds(delay_us), num_commands));
+		std::printf("\n");
+	}
+
+	return Sink == 42 ? 1 : 0;
+}
@@ -0,0 +1,387 @@
+//benchmark of the cache storage at 1024 clients and 4096 channels, built
+//without the SA-MP SDK:
+//	cmake -S bench -B build-bench && cmake --build build-bench
+//	build-bench/tsc-table-bench
+//"map (legacy)" stores every entity on its own in a hash map, the way the cache
+//used to, "slot table" is the ChannelTable/ClientTable the cache uses now; every
+//stage reports ns/entity and heap allocations/entity, "snapshot copy" also the
+//heap bytes one published snapshot of the storage takes
+//"publish" is the whole CServer::CopySnapshot (tables and indexes), once with
+//every index copied and once after a client moved, which only copies the
+//indexes that changed
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <boost/atomic.hpp>
+
+#include "CServer.hpp"
+#include "format.h"
+
+using std::string;
+using std::vector;
+typedef std::chrono::steady_clock Clock_t;
+
+
+static const unsigned int
+	NumChannels = 4096,
+	NumClients = 1024;
+
+
+static boost::atomic<unsigned long long>
+	AllocationCount(0),
+	AllocationBytes(0);
+
+void *operator new(size_t size)
+{
+	AllocationCount.fetch_add(1, boost::memory_order_relaxed);
+	AllocationBytes.fetch_add(size, boost::memory_order_relaxed);
+	if (void *ptr = std::malloc(size != 0 ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+
+//keeps results from being optimized away
+static size_t Sink = 0;
+
+struct StageResult
+{
+	unsigned long long
+		Items = 0,
+		Nanoseconds = 0,
+		Allocations = 0,
+		Bytes = 0;
+};
+
+//runs "stage" until at least "min_time" passed, "stage" returns the number of entities it handled
+static StageResult RunStage(std::function<size_t()> stage,
+	std::chrono::milliseconds min_time = std::chrono::milliseconds(300))
+{
+	stage(); //warm up
+
+	StageResult result;
+	const Clock_t::time_point start = Clock_t::now();
+	const unsigned long long
+		start_allocs = AllocationCount.load(),
+		start_bytes = AllocationBytes.load();
+	Clock_t::time_point now;
+	do
+	{
+		result.Items += stage();
+		now = Clock_t::now();
+	} while (now - start < min_time);
+
+	result.Allocations = AllocationCount.load() - start_allocs;
+	result.Bytes = AllocationBytes.load() - start_bytes;
+	result.Nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+	return result;
+}
+
+static void PrintStage(const char *name, const StageResult &result, bool print_bytes = false)
+{
+	const double
+		ns_per_item = static_cast<double>(result.Nanoseconds) / result.Items,
+		allocs_per_item = static_cast<double>(result.Allocations) / result.Items;
+	std::printf("  %-26s %10.1f ns/entity %8.2f allocs/entity", name, ns_per_item, allocs_per_item);
+	if (print_bytes)
+		std::printf(" %8.1f bytes/entity", static_cast<double>(result.Bytes) / result.Items);
+	std::printf("\n");
+}
+
+
+//what a channel- and clientlist of a big server looks like: ids are handed out
+//in ascending order, deleted ones leave gaps; client ids grow with every connect,
+//so after a long uptime the gaps between the online clients are "client_id_gap"
+struct Population
+{
+	vector<std::pair<Channel::Id_t, Channel>> Channels;
+	vector<std::pair<Client::Id_t, Client>> Clients;
+	//the order the getters are called in, one id per lookup
+	vector<Client::Id_t> LookupOrder;
+};
+
+static void Populate(Population &population, unsigned int client_id_gap)
+{
+	std::mt19937 rng(4096);
+
+	Channel::Id_t cid = 0;
+	for (unsigned int n = 0; n != NumChannels; ++n)
+	{
+		cid += rng() % 8 == 0 ? 2 : 1;
+
+		Channel channel;
+		//a few top level channels, the rest are sub channels of earlier ones
+		channel.ParentId = n < 64 ? 0 : population.Channels[rng() % n].first;
+		channel.OrderId = n != 0 ? population.Channels.back().first : 0;
+		channel.Name = fmt::format("Channel {} [{}]", n, rng() % 1000);
+		channel.Type = Channel::Types::PERMANENT;
+		channel.HasPassword = rng() % 4 == 0;
+		channel.RequiredTalkPower = rng() % 2 == 0 ? 0 : 50;
+		channel.MaxClients = -1;
+		population.Channels.emplace_back(cid, std::move(channel));
+	}
+
+	Client::Id_t clid = 0;
+	for (unsigned int n = 0; n != NumClients; ++n)
+	{
+		clid += rng() % 4 == 0 ? client_id_gap : 1;
+
+		Client client;
+		client.DatabaseId = 1000 + n;
+		client.Uid = fmt::format("{:020}{:08}=", rng(), n);
+		client.IpAddress = fmt::format("10.{}.{}.{}", rng() % 256, rng() % 256, rng() % 256);
+		client.CurrentChannel = population.Channels[rng() % NumChannels].first;
+		population.Clients.emplace_back(clid, std::move(client));
+		population.LookupOrder.push_back(clid);
+	}
+	std::shuffle(population.LookupOrder.begin(), population.LookupOrder.end(), rng);
+}
+
+
+//the storage the cache used before the slot tables
+struct MapCache
+{
+	unordered_map<Channel::Id_t, shared_ptr<Channel>> Channels;
+	unordered_map<Client::Id_t, shared_ptr<Client>> Clients;
+
+	void Fill(const Population &population)
+	{
+		for (auto &c : population.Channels)
+			Channels.emplace(c.first, std::make_shared<Channel>(c.second));
+		for (auto &c : population.Clients)
+			Clients.emplace(c.first, std::make_shared<Client>(c.second));
+	}
+
+	size_t GetCount() const
+	{
+		return Channels.size() + Clients.size();
+	}
+
+	//what a gamemode does per player: the required talk power of the client's channel
+	int GetTalkPower(Client::Id_t clid) const
+	{
+		auto client_it = Clients.find(clid);
+		if (client_it == Clients.end())
+			return 0;
+		auto channel_it = Channels.find(client_it->second->CurrentChannel);
+		return channel_it != Channels.end() ? channel_it->second->RequiredTalkPower : 0;
+	}
+	//passworded channels and clients in a channel with talk power
+	size_t Scan() const
+	{
+		size_t count = 0;
+		for (auto &c : Channels)
+			count += c.second->HasPassword ? 1 : 0;
+		for (auto &c : Clients)
+			count += GetTalkPower(c.first) != 0 ? 1 : 0;
+		return count;
+	}
+	//the copy the snapshots were published with: plain values
+	void CopyTo(unordered_map<Channel::Id_t, Channel> &channels,
+		unordered_map<Client::Id_t, Client> &clients) const
+	{
+		channels.reserve(Channels.size());
+		for (auto &c : Channels)
+			channels.emplace(c.first, *c.second);
+		clients.reserve(Clients.size());
+		for (auto &c : Clients)
+			clients.emplace(c.first, *c.second);
+	}
+};
+
+struct TableCache
+{
+	ChannelTable Channels;
+	CSharedPart<ChannelNameIndex_t> ChannelNameIndex;
+	CSharedPart<ChannelChildren_t> ChannelChildren;
+	ClientTable Clients;
+	CSharedPart<ClientIndex_t>
+		ClientUidIndex,
+		ClientIpIndex;
+	CSharedPart<ChannelClients_t> ChannelClients;
+
+	void Fill(const Population &population)
+	{
+		for (auto &c : population.Channels)
+			Channels.Insert(c.first, c.second);
+		for (auto &c : population.Clients)
+			Clients.Insert(c.first, c.second);
+	}
+	//the indexes are only needed for the publish stages
+	void FillIndexes(const Population &population)
+	{
+		for (auto &c : population.Channels)
+		{
+			ChannelNameIndex.Edit().emplace(c.second.Name, c.first);
+			ChannelChildren.Edit()[c.second.ParentId].push_back(c.first);
+		}
+		for (auto &c : population.Clients)
+		{
+			ClientUidIndex.Edit().emplace(c.second.Uid, c.first);
+			ClientIpIndex.Edit().emplace(c.second.IpAddress, c.first);
+			ChannelClients.Edit()[c.second.CurrentChannel].push_back(c.first);
+		}
+	}
+
+	size_t GetCount() const
+	{
+		return Channels.GetCount() + Clients.GetCount();
+	}
+
+	int GetTalkPower(Client::Id_t clid) const
+	{
+		const ClientTable::Slot_t client_slot = Clients.Find(clid);
+		if (client_slot == ClientTable::NoSlot)
+			return 0;
+		const ChannelTable::Slot_t channel_slot = Channels.Find(Clients.CurrentChannel[client_slot]);
+		return channel_slot != ChannelTable::NoSlot ? Channels.RequiredTalkPower[channel_slot] : 0;
+	}
+	size_t Scan() const
+	{
+		size_t count = 0;
+		Channels.ForEach([&](Channel::Id_t, ChannelTable::Slot_t slot)
+		{
+			count += Channels.HasFlag(slot, ChannelTable::HAS_PASSWORD) ? 1 : 0;
+		});
+		Clients.ForEach([&](Client::Id_t clid, ClientTable::Slot_t)
+		{
+			count += GetTalkPower(clid) != 0 ? 1 : 0;
+		});
+		return count;
+	}
+
+	//the snapshot CServer publishes, "copy_indexes" copies every index instead of sharing it
+	shared_ptr<CacheSnapshot> CopySnapshot(bool copy_indexes)
+	{
+		shared_ptr<CacheSnapshot> snapshot = std::make_shared<CacheSnapshot>();
+		snapshot->Channels = Channels;
+		snapshot->Clients = Clients;
+		if (copy_indexes)
+		{
+			snapshot->ChannelNameIndex = std::make_shared<const ChannelNameIndex_t>(ChannelNameIndex.Get());
+			snapshot->ChannelChildren = std::make_shared<const ChannelChildren_t>(ChannelChildren.Get());
+			snapshot->ClientUidIndex = std::make_shared<const ClientIndex_t>(ClientUidIndex.Get());
+			snapshot->ClientIpIndex = std::make_shared<const ClientIndex_t>(ClientIpIndex.Get());
+			snapshot->ChannelClients = std::make_shared<const ChannelClients_t>(ChannelClients.Get());
+		}
+		else
+		{
+			snapshot->ChannelNameIndex = ChannelNameIndex.Share();
+			snapshot->ChannelChildren = ChannelChildren.Share();
+			snapshot->ClientUidIndex = ClientUidIndex.Share();
+			snapshot->ClientIpIndex = ClientIpIndex.Share();
+			snapshot->ChannelClients = ChannelClients.Share();
+		}
+		return snapshot;
+	}
+	//what a "notifyclientmoved" changes
+	void MoveClient(Client::Id_t clid, Channel::Id_t cid)
+	{
+		const ClientTable::Slot_t slot = Clients.Find(clid);
+		ChannelClients_t &channel_clients = ChannelClients.Edit();
+		vector<Client::Id_t> &members = channel_clients[Clients.CurrentChannel[slot]];
+		members.erase(std::find(members.begin(), members.end(), clid));
+		Clients.CurrentChannel[slot] = cid;
+		channel_clients[cid].push_back(clid);
+	}
+};
+
+
+template<typename Cache_t>
+static void RunStorage(const char *name, const Population &population,
+	std::function<size_t(const Cache_t &cache)> copy_stage)
+{
+	std::printf("%s:\n", name);
+
+	const size_t num_entities = population.Channels.size() + population.Clients.size();
+	PrintStage("build", RunStage([&]()
+	{
+		Cache_t cache;
+		cache.Fill(population);
+		Sink += cache.GetCount();
+		return num_entities;
+	}));
+
+	Cache_t cache;
+	cache.Fill(population);
+	PrintStage("lookup (client -> channel)", RunStage([&]()
+	{
+		int sum = 0;
+		for (Client::Id_t clid : population.LookupOrder)
+			sum += cache.GetTalkPower(clid);
+		Sink += sum;
+		return population.LookupOrder.size();
+	}));
+	PrintStage("scan", RunStage([&]()
+	{
+		Sink += cache.Scan();
+		return num_entities;
+	}));
+	PrintStage("snapshot copy", RunStage([&]()
+	{
+		return copy_stage(cache);
+	}), true);
+}
+
+
+int main()
+{
+	for (unsigned int client_id_gap : { 2, 200 })
+	{
+		Population population;
+		Populate(population, client_id_gap);
+
+		std::printf("cache storage: %u channels (highest id %u), %u clients (highest id %u)\n",
+			NumChannels, population.Channels.back().first,
+			NumClients, population.Clients.back().first);
+
+		RunStorage<MapCache>("map (legacy)", population, [](const MapCache &cache)
+		{
+			unordered_map<Channel::Id_t, Channel> channels;
+			unordered_map<Client::Id_t, Client> clients;
+			cache.CopyTo(channels, clients);
+			Sink += channels.size() + clients.size();
+			return channels.size() + clients.size();
+		});
+		RunStorage<TableCache>("slot table", population, [](const TableCache &cache)
+		{
+			ChannelTable channels(cache.Channels);
+			ClientTable clients(cache.Clients);
+			Sink += channels.GetCount() + clients.GetCount();
+			return channels.GetCount() + clients.GetCount();
+		});
+
+		TableCache cache;
+		cache.Fill(population);
+		cache.FillIndexes(population);
+		const size_t num_entities = cache.GetCount();
+		PrintStage("publish (copy all)", RunStage([&]()
+		{
+			Sink += cache.CopySnapshot(true)->Version;
+			return num_entities;
+		}), true);
+		size_t move = 0;
+		PrintStage("publish (client moved)", RunStage([&]()
+		{
+			const Client::Id_t clid = population.LookupOrder[move % NumClients];
+			cache.MoveClient(clid, population.Channels[move % NumChannels].first);
+			++move;
+			Sink += cache.CopySnapshot(false)->Version;
+			return num_entities;
+		}), true);
+	}
+
+	return Sink == 42 ? 1 : 0;
+}
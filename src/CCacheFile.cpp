@@ -0,0 +1,351 @@
+#include "CCacheFile.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <boost/crc.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+namespace ipc = boost::interprocess;
+
+
+namespace
+{
+	const char FileMagic[4] = { 'T', 'S', 'C', 'C' };
+	//has to be increased whenever one of the structs below changes
+	const uint32_t FileFormatVersion = 1;
+
+	//position in the string data following the records
+	struct StringRef
+	{
+		uint32_t
+			Offset,
+			Length;
+	};
+
+	struct FileHeader
+	{
+		char Magic[4];
+		uint32_t FormatVersion;
+		uint32_t Checksum; //CRC-32 of everything after the header
+		uint16_t Port;
+		uint16_t Reserved;
+		StringRef Host;
+		uint32_t DefaultChannel;
+		uint32_t
+			NumChannels,
+			NumClients,
+			StringsSize;
+	};
+
+	struct ChannelRecord
+	{
+		uint32_t
+			Id,
+			ParentId,
+			OrderId;
+		int32_t
+			RequiredTalkPower,
+			MaxClients;
+		uint8_t
+			Type,
+			HasPassword,
+			Reserved[2];
+		StringRef Name;
+	};
+
+	struct ClientRecord
+	{
+		uint32_t
+			Id,
+			CurrentChannel,
+			DatabaseId;
+		StringRef
+			Uid,
+			IpAddress;
+	};
+
+	StringRef AddString(string &strings, const string &str)
+	{
+		StringRef ref;
+		ref.Offset = static_cast<uint32_t>(strings.length());
+		ref.Length = static_cast<uint32_t>(str.length());
+		strings.append(str);
+		return ref;
+	}
+
+	bool GetString(const char *strings, uint32_t strings_size, StringRef ref, string &dest)
+	{
+		if (static_cast<uint64_t>(ref.Offset) + ref.Length > strings_size)
+			return false;
+
+		dest.assign(strings + ref.Offset, ref.Length);
+		return true;
+	}
+}
+
+
+CCacheFile::~CCacheFile()
+{
+	{
+		boost::lock_guard<boost::mutex> mtx_guard(m_Mutex);
+		m_IsStopping = true;
+	}
+	m_WriterCondition.notify_all();
+
+	if (m_WriterThread != nullptr)
+	{
+		m_WriterThread->join();
+		delete m_WriterThread;
+	}
+}
+
+void CCacheFile::SetPath(string path, unsigned int save_interval)
+{
+	boost::unique_lock<boost::mutex> lock(m_Mutex);
+	WaitForWriter(lock);
+	m_Path = std::move(path);
+	m_SaveInterval = save_interval;
+	m_LastSave = Clock_t::now();
+}
+
+bool CCacheFile::Open(const string &host, unsigned short port, Content &content)
+{
+	//the file might still be written by a previous connection
+	boost::unique_lock<boost::mutex> lock(m_Mutex);
+	WaitForWriter(lock);
+	m_Host = host;
+	m_Port = port;
+	m_LastSave = Clock_t::now();
+
+	if (m_Path.empty())
+		return false;
+
+
+	//a missing, empty or locked file just means there's nothing to start from
+	ipc::mapped_region region;
+	try
+	{
+		ipc::file_mapping mapping(m_Path.c_str(), ipc::read_only);
+		ipc::mapped_region(mapping, ipc::read_only).swap(region);
+	}
+	catch (const ipc::interprocess_exception &)
+	{
+		return false;
+	}
+
+	const char *data = static_cast<const char *>(region.get_address());
+	const size_t size = region.get_size();
+	if (size < sizeof(FileHeader))
+		return false;
+
+	FileHeader header;
+	std::memcpy(&header, data, sizeof(FileHeader));
+	if (std::memcmp(header.Magic, FileMagic, sizeof(FileMagic)) != 0
+		|| header.FormatVersion != FileFormatVersion)
+		return false;
+
+	const uint64_t expected_size = sizeof(FileHeader)
+		+ static_cast<uint64_t>(header.NumChannels) * sizeof(ChannelRecord)
+		+ static_cast<uint64_t>(header.NumClients) * sizeof(ClientRecord)
+		+ header.StringsSize;
+	if (expected_size != size)
+		return false;
+
+	boost::crc_32_type crc;
+	crc.process_bytes(data + sizeof(FileHeader), size - sizeof(FileHeader));
+	if (crc.checksum() != header.Checksum)
+		return false;
+
+	const ChannelRecord *channels = reinterpret_cast<const ChannelRecord *>(data + sizeof(FileHeader));
+	const ClientRecord *clients = reinterpret_cast<const ClientRecord *>(channels + header.NumChannels);
+	const char *strings = reinterpret_cast<const char *>(clients + header.NumClients);
+
+	string saved_host;
+	if (GetString(strings, header.StringsSize, header.Host, saved_host) == false
+		|| saved_host != host || header.Port != port)
+		return false;
+
+
+	Content file_content;
+	file_content.DefaultChannel = header.DefaultChannel;
+	file_content.Channels.reserve(header.NumChannels);
+	for (uint32_t i = 0; i != header.NumChannels; ++i)
+	{
+		const ChannelRecord &record = channels[i];
+		Channel channel;
+		channel.ParentId = record.ParentId;
+		channel.OrderId = record.OrderId;
+		channel.Type = static_cast<Channel::Types>(record.Type);
+		channel.HasPassword = record.HasPassword != 0;
+		channel.RequiredTalkPower = record.RequiredTalkPower;
+		channel.MaxClients = record.MaxClients;
+		if (GetString(strings, header.StringsSize, record.Name, channel.Name) == false)
+			return false;
+
+		file_content.Channels.emplace_back(record.Id, std::move(channel));
+	}
+
+	file_content.Clients.reserve(header.NumClients);
+	for (uint32_t i = 0; i != header.NumClients; ++i)
+	{
+		const ClientRecord &record = clients[i];
+		Client client;
+		client.CurrentChannel = record.CurrentChannel;
+		client.DatabaseId = record.DatabaseId;
+		if (GetString(strings, header.StringsSize, record.Uid, client.Uid) == false
+			|| GetString(strings, header.StringsSize, record.IpAddress, client.IpAddress) == false)
+			return false;
+
+		file_content.Clients.emplace_back(record.Id, std::move(client));
+	}
+
+	content = std::move(file_content);
+	return true;
+}
+
+bool CCacheFile::Save(CacheSnapshot_t snapshot)
+{
+	boost::lock_guard<boost::mutex> mtx_guard(m_Mutex);
+	if (m_Path.empty() || m_Host.empty() || m_IsStopping)
+		return false;
+
+	m_LastSave = Clock_t::now();
+	m_PendingWrite = std::move(snapshot);
+	if (m_WriterThread == nullptr)
+		m_WriterThread = new boost::thread([this]() { RunWriter(); });
+	m_WriterCondition.notify_all();
+	return true;
+}
+
+void CCacheFile::OnSnapshotPublished(const CacheSnapshot_t &snapshot)
+{
+	{
+		boost::lock_guard<boost::mutex> mtx_guard(m_Mutex);
+		if (m_SaveInterval == 0
+			|| Clock_t::now() - m_LastSave < boost::chrono::seconds(m_SaveInterval))
+			return;
+	}
+
+	Save(snapshot);
+}
+
+void CCacheFile::WaitForWriter(boost::unique_lock<boost::mutex> &lock)
+{
+	while (m_PendingWrite != nullptr || m_IsWriting)
+		m_WriterCondition.wait(lock);
+}
+
+void CCacheFile::RunWriter()
+{
+	boost::unique_lock<boost::mutex> lock(m_Mutex);
+	while (true)
+	{
+		while (m_PendingWrite == nullptr && m_IsStopping == false)
+			m_WriterCondition.wait(lock);
+
+		//everything queued is written before the thread stops
+		if (m_PendingWrite == nullptr)
+			break;
+
+		CacheSnapshot_t snapshot;
+		snapshot.swap(m_PendingWrite);
+		const string
+			path = m_Path,
+			host = m_Host;
+		const unsigned short port = m_Port;
+		m_IsWriting = true;
+
+		lock.unlock();
+		Write(*snapshot, path, host, port);
+		//freed without holding the lock
+		snapshot.reset();
+		lock.lock();
+
+		m_IsWriting = false;
+		m_WriterCondition.notify_all();
+	}
+}
+
+bool CCacheFile::Write(const CacheSnapshot &snapshot, const string &path,
+	const string &host, unsigned short port)
+{
+	string strings;
+	vector<ChannelRecord> channels;
+	channels.reserve(snapshot.Channels.GetCount());
+	snapshot.Channels.ForEach([&](Channel::Id_t cid, ChannelTable::Slot_t slot)
+	{
+		ChannelRecord record = ChannelRecord();
+		record.Id = cid;
+		record.ParentId = snapshot.Channels.ParentId[slot];
+		record.OrderId = snapshot.Channels.OrderId[slot];
+		record.RequiredTalkPower = snapshot.Channels.RequiredTalkPower[slot];
+		record.MaxClients = snapshot.Channels.MaxClients[slot];
+		record.Type = static_cast<uint8_t>(snapshot.Channels.Type[slot]);
+		record.HasPassword = snapshot.Channels.HasFlag(slot, ChannelTable::HAS_PASSWORD) ? 1 : 0;
+		record.Name = AddString(strings, snapshot.Channels.GetName(slot));
+		channels.push_back(record);
+	});
+
+	vector<ClientRecord> clients;
+	clients.reserve(snapshot.Clients.GetCount());
+	snapshot.Clients.ForEach([&](Client::Id_t clid, ClientTable::Slot_t slot)
+	{
+		ClientRecord record = ClientRecord();
+		record.Id = clid;
+		record.CurrentChannel = snapshot.Clients.CurrentChannel[slot];
+		record.DatabaseId = snapshot.Clients.DatabaseId[slot];
+		record.Uid = AddString(strings, snapshot.Clients.GetUid(slot));
+		record.IpAddress = AddString(strings, snapshot.Clients.GetIpAddress(slot));
+		clients.push_back(record);
+	});
+
+	FileHeader header = FileHeader();
+	std::memcpy(header.Magic, FileMagic, sizeof(FileMagic));
+	header.FormatVersion = FileFormatVersion;
+	header.Port = port;
+	header.Host = AddString(strings, host);
+	header.DefaultChannel = snapshot.DefaultChannel;
+	header.NumChannels = static_cast<uint32_t>(channels.size());
+	header.NumClients = static_cast<uint32_t>(clients.size());
+	header.StringsSize = static_cast<uint32_t>(strings.length());
+
+	boost::crc_32_type crc;
+	crc.process_bytes(channels.data(), channels.size() * sizeof(ChannelRecord));
+	crc.process_bytes(clients.data(), clients.size() * sizeof(ClientRecord));
+	crc.process_bytes(strings.data(), strings.length());
+	header.Checksum = crc.checksum();
+
+
+	//written next to the old file and renamed, so a crash never leaves a half-written one
+	const string temp_path = path + ".tmp";
+	{
+		std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char *>(&header), sizeof(FileHeader));
+		file.write(reinterpret_cast<const char *>(channels.data()), channels.size() * sizeof(ChannelRecord));
+		file.write(reinterpret_cast<const char *>(clients.data()), clients.size() * sizeof(ClientRecord));
+		file.write(strings.data(), strings.length());
+		if (file.good() == false)
+		{
+			file.close();
+			std::remove(temp_path.c_str());
+			return false;
+		}
+	}
+
+#ifdef _WIN32
+	//rename doesn't replace existing files on Windows, removing the old file first
+	//would leave no file at all if the rename fails
+	return MoveFileExA(temp_path.c_str(), path.c_str(),
+		MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return std::rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+}
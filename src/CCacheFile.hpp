@@ -0,0 +1,88 @@
+#pragma once
+#ifndef INC_CCACHEFILE_H
+#define INC_CCACHEFILE_H
+
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/chrono/chrono.hpp>
+
+#include "CSingleton.hpp"
+#include "CServer.hpp"
+
+using std::string;
+using std::vector;
+
+
+//the server cache written to a file, so a restarted gamemode can serve the
+//natives from it right away instead of waiting for the channel- and clientlist;
+//the file is only a hint, it's validated against the lists once logged in
+//format (host byte order): header, channel records, client records, strings;
+//the records are fixed-size and read straight from the mapped file
+//the file is written by a thread of its own, the network thread only hands over
+//the snapshot; a newer snapshot replaces one that wasn't written yet
+class CCacheFile : public CSingleton<CCacheFile>
+{
+	friend class CSingleton<CCacheFile>;
+public: //definitions
+	typedef boost::chrono::steady_clock Clock_t;
+
+	//what was read from the file, in the form CServer adds entities in
+	struct Content
+	{
+		vector<std::pair<Channel::Id_t, Channel>> Channels;
+		Channel::Id_t DefaultChannel = Channel::Invalid;
+		vector<std::pair<Client::Id_t, Client>> Clients;
+	};
+
+private: //variables
+	boost::mutex m_Mutex;
+	boost::condition_variable m_WriterCondition;
+	boost::thread *m_WriterThread = nullptr;
+	CacheSnapshot_t m_PendingWrite; //null if there's nothing to write
+	bool m_IsWriting = false;
+	bool m_IsStopping = false;
+
+	string m_Path; //empty if disabled
+	unsigned int m_SaveInterval = 0; //seconds, 0 only saves on disconnect
+
+	//the server the cache is about, a file of another server is ignored
+	string m_Host;
+	unsigned short m_Port = 0;
+
+	Clock_t::time_point m_LastSave;
+
+
+private: //constructor / deconstructor
+	CCacheFile() = default;
+	//writes the pending snapshot before returning
+	~CCacheFile();
+
+
+public: //functions
+	void SetPath(string path, unsigned int save_interval);
+
+	//sets the server saved snapshots belong to and loads the
+	//file if it's about the same one
+	bool Open(const string &host, unsigned short port, Content &content);
+
+	//queues the snapshot for the writer thread, returns false if saving is disabled
+	bool Save(CacheSnapshot_t snapshot);
+	//saves if the save interval passed since the last save
+	void OnSnapshotPublished(const CacheSnapshot_t &snapshot);
+
+private: //functions
+	//waits until the writer thread is done with everything queued
+	void WaitForWriter(boost::unique_lock<boost::mutex> &lock);
+	void RunWriter();
+	static bool Write(const CacheSnapshot &snapshot, const string &path,
+		const string &host, unsigned short port);
+
+};
+
+
+#endif // INC_CCACHEFILE_H
@@ -5,9 +5,16 @@
 
 void CCallbackHandler::Process()
 {
-	Callback_t callback;
-	while (m_Queue.pop(callback))
+	Callback_t callback = std::move(m_HeldCallback);
+	while (callback || m_Queue.pop(callback))
 	{
+		//the difference handles the version wrapping around
+		if (static_cast<int>(callback->m_CacheVersion - m_PublishedCacheVersion) > 0)
+		{
+			m_HeldCallback = std::move(callback);
+			break;
+		}
+
 		for (auto amx : m_AmxList) 
 		{
 			int cb_idx;
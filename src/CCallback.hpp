@@ -11,6 +11,7 @@
 #include <functional>
 #include <memory>
 #include <boost/variant.hpp>
+#include <boost/atomic.hpp>
 #include <boost/unordered_set.hpp>
 #include <boost/lockfree/spsc_queue.hpp>
 
@@ -30,7 +31,8 @@ enum class EErrorType
 	INVALID,
 	CONNECTION_ERROR,
 	TEAMSPEAK_ERROR,
-	CALLBACK_ERROR
+	CALLBACK_ERROR,
+	TIMEOUT_ERROR
 };
 
 class CCallback
@@ -42,6 +44,8 @@ private: //variables
 	function<void()>
 		m_PreExecute,
 		m_PostExecute;
+	//version of the server cache this callback was queued at
+	unsigned int m_CacheVersion = 0;
 
 
 public: //constructor / destructor
@@ -86,7 +90,10 @@ class CCallbackHandler : public CSingleton<CCallbackHandler>
 {
 	friend class CSingleton<CCallbackHandler>;
 private: //constructor / deconstructor
-	CCallbackHandler() {}
+	CCallbackHandler() :
+		m_CacheVersion(0),
+		m_PublishedCacheVersion(0)
+	{}
 	~CCallbackHandler() {}
 
 
@@ -99,6 +106,14 @@ private: //variables
 
 	unordered_set<AMX *> m_AmxList;
 
+	//callbacks are held back until the natives can see the cache changes
+	//they are about; "m_HeldCallback" is the first one still waiting
+	//the versions are counted here, so they keep increasing across CServer instances
+	boost::atomic<unsigned int>
+		m_CacheVersion,
+		m_PublishedCacheVersion;
+	Callback_t m_HeldCallback;
+
 
 public: //functions
 	Callback_t Create(string name, string format,
@@ -106,6 +121,7 @@ public: //functions
 
 	inline void Call(Callback_t callback)
 	{
+		callback->m_CacheVersion = m_CacheVersion;
 		m_Queue.push(callback);
 	}
 	template <typename... Args>
@@ -131,6 +147,21 @@ public: //functions
 		m_AmxList.erase(amx);
 	}
 
+	//callbacks queued from now on are about the returned version
+	inline unsigned int IncreaseCacheVersion()
+	{
+		return ++m_CacheVersion;
+	}
+	inline void SetPublishedCacheVersion(unsigned int version)
+	{
+		m_PublishedCacheVersion = version;
+	}
+	//for when the cache goes away, nothing would publish the held back versions
+	inline void ReleaseHeldCallbacks()
+	{
+		m_PublishedCacheVersion = m_CacheVersion.load();
+	}
+
 
 	void Process();
 };
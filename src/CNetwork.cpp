@@ -1,87 +1,98 @@
 #include "main.hpp"
 #include "CNetwork.hpp"
 #include "CServer.hpp"
-#include "CUtils.hpp"
 #include "CCallback.hpp"
+#include "CUtils.hpp"
 
-#include <istream>
-#include <boost/date_time/posix_time/posix_time.hpp>
+#include <cstdlib>
 
 #include "format.h"
 
 
-void CNetwork::NetAlive(const boost::system::error_code &error_code, bool from_write)
+bool CNetwork::Connect(string hostname, unsigned short port,
+	unsigned short query_port, unsigned int session_count)
 {
-	if (from_write == true)
-		return;
-	
-	if (error_code.value() != 0)
-		return;
-
+	if (session_count == 0)
+		return false;
 
-	if (m_Socket.is_open())
+	if (m_Sessions.empty() == false)
 	{
-		static string empty_data("\n");
-		m_Socket.async_send(asio::buffer(empty_data), 
-			boost::bind(&CNetwork::NetAlive, this, boost::asio::placeholders::error, true));
+		//the sessions of a failed connection are closed (see OnSessionFailed)
+		if (m_Sessions.front()->IsClosed() == false)
+			return false;
+
+		//nothing keeps the network thread running anymore, it finishes
+		//the handlers of the closed sessions before they're deleted
+		if (m_IoThread != nullptr)
+		{
+			m_IoThread->join();
+			delete m_IoThread;
+			m_IoThread = nullptr;
+		}
+		Disconnect();
 	}
-	m_AliveTimer.expires_from_now(boost::posix_time::seconds(60));
-	m_AliveTimer.async_wait(
-		boost::bind(&CNetwork::NetAlive, this, boost::asio::placeholders::error, false));
-}
 
 
-bool CNetwork::Connect(string hostname, unsigned short port, unsigned short query_port)
-{
-	if (IsConnected())
-		return false;
+	m_ServerPort = port;
+
+	//commands executed meanwhile are queued until the sessions are ready
+	for (unsigned int s = 0; s != session_count; ++s)
+		m_Sessions.push_back(new CQuerySession(*this, m_IoService, s));
 
-	boost::system::error_code error;
-	tcp::resolver resolver(m_IoService);
 	tcp::resolver::query query(tcp::v4(), hostname, string());
-	tcp::resolver::iterator i = resolver.resolve(query, error);
+	m_Resolver.async_resolve(query,
+		boost::bind(&CNetwork::OnResolve, this, _1, _2, hostname, query_port));
 
-	if (error)
+	//the pending resolve keeps the io_service running
+	m_IoService.reset(); //stopped by an earlier Disconnect()
+	m_IoThread = new thread(boost::bind(&asio::io_service::run, boost::ref(m_IoService)));
+	return true;
+}
+
+void CNetwork::OnResolve(const boost::system::error_code &error_code, tcp::resolver::iterator endpoint_it,
+	string hostname, unsigned short query_port)
+{
+	if (error_code == asio::error::operation_aborted)
+		return;
+
+	if (error_code)
 	{
-		CCallbackHandler::Get()->ForwardError(
-			EErrorType::CONNECTION_ERROR, error.value(),
-			fmt::format("error while resolving hostname \"{}\": {}", hostname, error.message()));
-		return false;
+		string error_msg(fmt::format("error while resolving hostname \"{}\": {}", hostname, error_code.message()));
+		OnSessionFailed(*m_Sessions.front(), EErrorType::CONNECTION_ERROR, error_code.value(), error_msg);
+		return;
 	}
 
 
-	m_SocketDest = *i;
+	m_SocketDest = *endpoint_it;
 	m_SocketDest.port(query_port);
-	m_ServerPort = port;
-
-	AsyncConnect();
-	m_IoThread = new thread(boost::bind(&asio::io_service::run, boost::ref(m_IoService)));
 
-	return true;
+	//the other sessions are connected after the primary session logged in
+	m_Sessions.front()->Connect(m_SocketDest);
 }
 
 bool CNetwork::Disconnect()
 {
-	if (IsConnected())
+	m_Resolver.cancel();
+	for (auto &s : m_Sessions)
+		s->Quit();
+
+	auto start_time = boost::chrono::steady_clock::now();
+	while ((boost::chrono::steady_clock::now() - start_time) < boost::chrono::seconds(5))
 	{
-		Execute("quit", [this](ResultSet_t &res)
-		{
-			m_Connected = false;
-		});
+		bool any_connected = false;
+		for (auto &s : m_Sessions)
+			any_connected = any_connected || s->IsConnected();
 
-		auto start_time = boost::chrono::steady_clock::now();
-		while (m_Connected == true &&
-			(boost::chrono::steady_clock::now() - start_time) < boost::chrono::seconds(5))
-		{
-			boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
-		}
+		if (any_connected == false)
+			break;
+
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
 	}
 
-	m_Connected = false;
-	m_Socket.close();
-	m_AliveTimer.cancel();
+	for (auto &s : m_Sessions)
+		s->Close();
 	m_IoService.stop();
-	
+
 	if (m_IoThread != nullptr)
 	{
 		if (m_IoThread->get_id() != boost::this_thread::get_id())
@@ -89,233 +100,304 @@ bool CNetwork::Disconnect()
 		delete m_IoThread;
 		m_IoThread = nullptr;
 	}
+
+	for (auto &s : m_Sessions)
+		delete s;
+	m_Sessions.clear();
+	m_WorkersStarted = false;
+	m_LoginCmd.clear();
+	m_LoginCallback = ReadCallback_t();
 	return true;
 }
 
-void CNetwork::AsyncRead()
+void CNetwork::Login(const string &login, const string &pass, ReadCallback_t callback)
 {
-	asio::async_read_until(m_Socket, m_ReadStreamBuf, '\r', 
-		boost::bind(&CNetwork::OnRead, this, _1));
+	if (m_Sessions.empty())
+		return;
+
+	m_LoginCmd = fmt::format("login client_login_name={} client_login_password={}",
+		Escaped(login), Escaped(pass));
+	m_LoginCallback = boost::move(callback);
+	LoginSession(*m_Sessions.front());
 }
 
-void CNetwork::AsyncWrite(const string &data)
+void CNetwork::LoginSession(CQuerySession &session)
 {
-	boost::lock_guard<boost::mutex> lock_guard(m_CmdWriteBufferQueueMutex);
+	session.ExecuteSetup(m_LoginCmd, [this, &session](ResultSet_t &result)
+	{
+		session.SetReady(true);
+		if (&session != m_Sessions.front())
+			return;
 
-	m_CmdWriteBufferQueue.push(data);
-	string &cmd_write_buffer = m_CmdWriteBufferQueue.back();
+		if (m_WorkersStarted == false)
+		{
+			m_WorkersStarted = true;
+			for (size_t s = 1; s < m_Sessions.size(); ++s)
+				m_Sessions.at(s)->Connect(m_SocketDest);
+		}
 
-	if (cmd_write_buffer.back() != '\n')
-		cmd_write_buffer.push_back('\n');
+		if (m_LoginCallback)
+			m_LoginCallback(result);
+	});
+}
 
-	m_Socket.async_send(asio::buffer(cmd_write_buffer),
-		boost::bind(&CNetwork::OnWrite, this, _1));
+CNetwork::CommandId_t CNetwork::Execute(string cmd, ReadCallback_t callback,
+	ECommandPriority priority, unsigned int timeout, ErrorCallback_t error_callback)
+{
+	return ExecuteStreamed(boost::move(cmd), RowCallback_t(), boost::move(callback),
+		priority, timeout, boost::move(error_callback));
 }
 
-void CNetwork::AsyncConnect()
+CNetwork::CommandId_t CNetwork::ExecuteStreamed(string cmd, RowCallback_t row_callback,
+	ReadCallback_t callback, ECommandPriority priority, unsigned int timeout,
+	ErrorCallback_t error_callback)
 {
-	m_Connected = false;
-	m_Socket.async_connect(m_SocketDest, boost::bind(&CNetwork::OnConnect, this, _1));
+	CQuerySession *session = SelectSession(cmd);
+	if (session == nullptr)
+		return 0;
+
+	Command command;
+	command.Id = m_NextCommandId++;
+	if (command.Id == 0) //wrapped around
+		command.Id = m_NextCommandId++;
+	command.Cmd = boost::move(cmd);
+	command.Callback = boost::move(callback);
+	command.RowCallback = boost::move(row_callback);
+	command.ErrorCallback = boost::move(error_callback);
+	command.Priority = priority;
+	command.QueueTime = boost::chrono::steady_clock::now();
+
+	if (timeout == 0)
+		timeout = m_CommandTimeout;
+	if (timeout != 0)
+		command.Deadline = command.QueueTime + boost::chrono::milliseconds(timeout);
+
+	const CommandId_t id = command.Id;
+	session->Execute(boost::move(command));
+	return id;
 }
 
-void CNetwork::OnConnect(const boost::system::error_code &error_code)
+void CNetwork::Post(std::function<void()> &&func, unsigned int delay)
 {
-	if (error_code.value() == 0)
+	//the handler owns the timer, so it lives until the handler ran or the io_service is gone
+	std::shared_ptr<asio::deadline_timer> timer = std::make_shared<asio::deadline_timer>(
+		m_IoService, boost::posix_time::milliseconds(delay));
+	std::function<void()> callback(std::move(func));
+	timer->async_wait([timer, callback](const boost::system::error_code &error_code)
 	{
-		m_Connected = true;
-		Execute(fmt::format("use port={}", m_ServerPort));
-		AsyncRead();
+		if (error_code.value() == 0)
+			callback();
+	});
+}
 
-		//start heartbeat check
-		NetAlive(boost::system::error_code(), false);
-	}
-	else
+bool CNetwork::Cancel(CommandId_t id)
+{
+	for (auto &s : m_Sessions)
 	{
-		CCallbackHandler::Get()->ForwardError(
-			EErrorType::CONNECTION_ERROR, error_code.value(),
-			fmt::format("error while connecting to server: {}", error_code.message()));
+		if (s->Cancel(id))
+			return true;
 	}
+	return false;
 }
 
+bool CNetwork::SetPipelineDepth(unsigned int depth)
+{
+	if (depth == 0)
+		return false;
 
-/*
-	- result data is sent as a string which ends with "\n\r"
-	- the Teamspeak3 server can send multiple strings
-	- the end of a result set is always an error result string
-*/
-void CNetwork::OnRead(const boost::system::error_code &error_code)
+	for (auto &s : m_Sessions)
+		s->SetPipelineDepth(depth);
+	return true;
+}
+
+CNetwork::QueueWaitStats CNetwork::GetQueueWaitStats(ECommandPriority priority)
 {
-	if (error_code.value() == 0)
+	QueueWaitStats stats;
+	for (auto &s : m_Sessions)
 	{
-		static vector<string> captured_data;
-		std::istream tmp_stream(&m_ReadStreamBuf);
-		string read_data;
-		std::getline(tmp_stream, read_data, '\r');
-
-#ifdef _DEBUG
-		string dbg_read_data(read_data);
-		bool first_line = true;
-		do
-		{
-			logprintf("%s> %s", 
-				first_line == true ? ">>>" : "   ",
-				dbg_read_data.substr(0, 512).c_str());
-			dbg_read_data.erase(0, 512);
-			first_line = false;
-		} while (dbg_read_data.empty() == false);
-#endif
-
-		//regex: parse error
-		//if this is an error message, it means that no other result data will come
-		static const boost::regex error_rx("error id=([0-9]+) msg=([^ \n]+)");
-		boost::smatch error_rx_result;
-		if (boost::regex_search(read_data, error_rx_result, error_rx))
-		{
-			if (error_rx_result[1].str() == "0")
-			{
-				for (auto i = captured_data.begin(); i != captured_data.end(); ++i)
-				{
-					string &data = *i;
-					if (data.find('|') == string::npos) 
-						continue;
-
-					//we have multiple data rows with '|' as delimiter here,
-					//split them up and re-insert every single row
-					vector<string> result_set;
-					size_t delim_pos = 0;
-					do
-					{
-						size_t old_delim_pos = delim_pos;
-						delim_pos = data.find('|', delim_pos);
-						string row = data.substr(old_delim_pos, delim_pos - old_delim_pos);
-						result_set.push_back(row);
-					} while (delim_pos != string::npos && ++delim_pos);
-
-					i = captured_data.erase(i);
-					for (auto j = result_set.begin(), jend = result_set.end(); j != jend; ++j)
-						i = captured_data.insert(i, *j);
-				}
-				
-				//call callback and send next command
-				m_CmdQueueMutex.lock();
-				if (m_CmdQueue.empty() == false)
-				{
-					ReadCallback_t &callback = m_CmdQueue.front().get<1>();
-					if (callback)
-					{
-						m_CmdQueueMutex.unlock();
-						callback(captured_data); //calls the callback
-						m_CmdQueueMutex.lock();
-					}
-					m_CmdQueue.pop();
-
-					if (m_CmdQueue.empty() == false)
-						AsyncWrite(m_CmdQueue.front().get<0>());
-				}
-				m_CmdQueueMutex.unlock();
-			}
-			else
-			{
-				string error_str(error_rx_result[2].str());
-				unsigned int error_id = 0;
-
-				CUtils::Get()->UnEscapeString(error_str);
-				CUtils::Get()->ConvertStringToInt(error_rx_result[1].str(), error_id);
-
-				m_CmdQueueMutex.lock();
-
-				CCallbackHandler::Get()->ForwardError(
-					EErrorType::TEAMSPEAK_ERROR, error_id,
-					fmt::format("error while executing \"{}\": {}", m_CmdQueue.front().get<0>(), error_str));
-
-				m_CmdQueue.pop();
-
-				if (m_CmdQueue.empty() == false)
-					AsyncWrite(m_CmdQueue.front().get<0>());
-
-				m_CmdQueueMutex.unlock();
-			}
-
-			captured_data.clear();
-		}
-		else if (read_data.find("notify") == 0)
-		{
-			//check if notify is duplicate
-			static string last_notify_data;
-			static const vector<string> duplicate_notifies{ 
-				"notifyclientmoved", 
-				"notifycliententerview", 
-				"notifyclientleftview" 
-			};
-			bool is_duplicate = false;
-			
-			for (auto &s : duplicate_notifies)
-			{
-				if (read_data.find(s) == 0)
-				{
-					if (last_notify_data == read_data)
-						is_duplicate = true;
-					
-					break;
-				}
-			}
-			
-			if (is_duplicate == false)
-			{
-				//notify event
-				boost::smatch event_result;
-				for (auto &event : m_EventList)
-				{
-					if (boost::regex_search(read_data, event_result, event.get<0>()))
-					{
-						event.get<1>()(event_result);
-						break;
-					}
-				}
-			}
-
-			last_notify_data = read_data;
-		}
-		else
+		QueueWaitStats session_stats = s->GetQueueWaitStats(priority);
+		stats.Commands += session_stats.Commands;
+		stats.TotalWaitUs += session_stats.TotalWaitUs;
+		if (session_stats.MaxWaitUs > stats.MaxWaitUs)
+			stats.MaxWaitUs = session_stats.MaxWaitUs;
+	}
+	return stats;
+}
+
+CQuerySession *CNetwork::SelectSession(const string &cmd)
+{
+	if (m_Sessions.empty())
+		return nullptr;
+
+	CQuerySession *primary = m_Sessions.front();
+	if (m_Sessions.size() == 1)
+		return primary;
+
+
+	//these commands depend on or change the state of the query client itself
+	static const vector<string> session_bound_cmds{
+		"login",
+		"use",
+		"quit",
+		"whoami",
+		"clientupdate",
+		"servernotifyregister",
+		"servernotifyunregister",
+		"sendtextmessage"
+	};
+	const string cmd_name(cmd.substr(0, cmd.find(' ')));
+	for (auto &c : session_bound_cmds)
+	{
+		if (cmd_name == c)
+			return primary;
+	}
+
+	//commands targeting the same client or channel always use the same
+	//session, so they are executed in the order they were issued; they wait
+	//for it while it's (re-)connecting, only a retired session hands them over
+	static const vector<string> target_fields{
+		" clid=",
+		" cid=",
+		" cldbid="
+	};
+	const size_t worker_count = m_Sessions.size() - 1;
+	for (auto &f : target_fields)
+	{
+		size_t field_pos = cmd.find(f);
+		if (field_pos == string::npos)
+			continue;
+
+		unsigned long target_id = std::strtoul(cmd.c_str() + field_pos + f.length(), nullptr, 10);
+		CQuerySession *session = m_Sessions.at(1 + (target_id % worker_count));
+		return session->IsClosed() == false ? session : primary;
+	}
+
+	//everything else goes to the least busy session
+	CQuerySession *least_busy = nullptr;
+	size_t least_outstanding = 0;
+	for (size_t s = 1; s < m_Sessions.size(); ++s)
+	{
+		CQuerySession *session = m_Sessions.at(s);
+		if (session->IsReady() == false)
+			continue;
+
+		size_t outstanding = session->GetOutstandingCount();
+		if (least_busy == nullptr || outstanding < least_outstanding)
 		{
-			//stack the result data if it is not an error or notification message
-			captured_data.push_back(read_data);
+			least_busy = session;
+			least_outstanding = outstanding;
 		}
-
-		AsyncRead();
 	}
-	else //error
+	return least_busy != nullptr ? least_busy : primary;
+}
+
+void CNetwork::OnSessionConnected(CQuerySession &session)
+{
+	session.ExecuteSetup(fmt::format("use port={}", m_ServerPort), ReadCallback_t());
+
+	//the primary session logs in through Login() the first time
+	if (&session != m_Sessions.front() || session.CanReconnect())
+		LoginSession(session);
+}
+
+void CNetwork::OnSessionLost(CQuerySession &session)
+{
+	if (session.CanReconnect())
 	{
-		CCallbackHandler::Get()->ForwardError(
-			EErrorType::CONNECTION_ERROR, error_code.value(),
-			fmt::format("error while reading: {}", error_code.message()));
+		//the queued commands are kept until the session is back, so
+		//commands for the same target stay in order
+		session.ScheduleReconnect();
+		return;
+	}
 
+	if (&session == m_Sessions.front())
+	{
 		//"disable" the plugin, since calling Disconnect() or
 		//destroying CNetwork here is not very smart
 		CServer::CSingleton::Destroy();
-		m_Connected = false; //we're not _really_ connected, are we?
+	}
+	else
+	{
+		RetireSession(session);
 	}
 }
 
-void CNetwork::OnWrite(const boost::system::error_code &error_code)
+void CNetwork::RetireSession(CQuerySession &session)
 {
-	boost::lock_guard<boost::mutex> lock_guard(m_CmdWriteBufferQueueMutex);
-#ifdef _DEBUG
-	logprintf("<<<< %s", m_CmdWriteBufferQueue.front().c_str());
-#endif
-	m_CmdWriteBufferQueue.pop();
-	if (error_code.value() != 0)
+	session.Close();
+
+	//SelectSession skips closed sessions, so the commands which
+	//weren't sent yet go to the other sessions
+	queue<Command> pending_cmds;
+	session.TakePendingCommands(pending_cmds);
+	while (pending_cmds.empty() == false)
 	{
-		CCallbackHandler::Get()->ForwardError(
-			EErrorType::CONNECTION_ERROR, error_code.value(),
-			fmt::format("error while writing: {}", error_code.message()));
+		Command &cmd = pending_cmds.front();
+		CQuerySession *target = SelectSession(cmd.Cmd);
+		if (target != nullptr)
+			target->Execute(boost::move(cmd));
+		pending_cmds.pop();
 	}
 }
 
-void CNetwork::Execute(string cmd, ReadCallback_t callback)
+void CNetwork::OnSessionFailed(CQuerySession &session,
+	EErrorType error_type, unsigned int error_id, const string &error_msg)
 {
-	boost::lock_guard<boost::mutex> queue_lock_guard(m_CmdQueueMutex);
-	m_CmdQueue.push(boost::make_tuple(boost::move(cmd), boost::move(callback)));
-	if (m_CmdQueue.size() == 1)
-		AsyncWrite(m_CmdQueue.front().get<0>());
+	//only the primary session decides whether we're connected,
+	//a worker which can't log in just isn't used
+	if (&session != m_Sessions.front())
+	{
+		RetireSession(session);
+		return;
+	}
+
+	CCallbackHandler::Get()->Call("TSC_OnConnectFailed",
+		static_cast<std::underlying_type<EErrorType>::type>(error_type),
+		error_id, error_msg);
+
+	//Disconnect() can't be called on the network thread, closing the sessions
+	//stops everything and Connect() cleans them up; like a lost connection,
+	//the cache goes away
+	for (auto &s : m_Sessions)
+		s->Close();
+	CServer::CSingleton::Destroy();
+}
+
+void CNetwork::OnNotify(boost::string_ref notify_data)
+{
+	const boost::string_ref verb = notify_data.substr(0, notify_data.find_first_of(" \n\r"));
+
+	auto handler_it = m_NotifyHandlers.find(verb, NotifyVerbHash(), NotifyVerbEqual());
+	if (handler_it != m_NotifyHandlers.end())
+	{
+		boost::string_ref entries(notify_data);
+		entries.remove_prefix(verb.length());
+
+		size_t delim_pos = entries.find('|');
+		const CResultRow first_row(entries.substr(0, delim_pos), m_NotifyFields[0]);
+		handler_it->second(first_row);
+
+		while (delim_pos != boost::string_ref::npos)
+		{
+			entries.remove_prefix(delim_pos + 1);
+			delim_pos = entries.find('|');
+			handler_it->second(CResultRow(entries.substr(0, delim_pos), m_NotifyFields[1], &first_row));
+		}
+		return;
+	}
+
+	if (m_EventList.empty())
+		return;
+
+	//the callbacks get a match on a string
+	const string notify_str(notify_data.data(), notify_data.length());
+	boost::smatch event_result;
+	for (auto &event : m_EventList)
+	{
+		if (boost::regex_search(notify_str, event_result, event.get<0>()))
+		{
+			event.get<1>()(event_result);
+			break;
+		}
+	}
 }
@@ -13,10 +13,15 @@
 #include <boost/tuple/tuple.hpp>
 #include <boost/regex.hpp>
 #include <boost/atomic.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility/string_ref.hpp>
 
 #include "format.h"
 
 #include "CSingleton.hpp"
+#include "CQuerySession.hpp"
+#include "CTokenBucket.hpp"
+#include "CResultRow.hpp"
 
 using std::vector;
 using std::queue;
@@ -28,45 +33,83 @@ using asio::ip::tcp;
 using boost::tuple;
 using boost::atomic;
 
+enum class EErrorType;
 
 
 class CNetwork : public CSingleton<CNetwork>
 {
 	friend class CSingleton<CNetwork>;
+	friend class CQuerySession;
 public: //definitions
-	typedef vector<string> ResultSet_t;
-	typedef std::function<void(ResultSet_t &)> ReadCallback_t;
-	typedef tuple<string, ReadCallback_t> CmdTuple_t;
+	typedef CQuerySession::ResultSet_t ResultSet_t;
+	typedef CQuerySession::ReadCallback_t ReadCallback_t;
+	typedef CQuerySession::RowCallback_t RowCallback_t;
+	typedef CQuerySession::ErrorCallback_t ErrorCallback_t;
+	typedef CQuerySession::Command Command;
+	typedef CQuerySession::CommandId_t CommandId_t;
+	typedef CQuerySession::QueueWaitStats QueueWaitStats;
+
+	//called once per entry of a notify, entries after the first
+	//("notifyclientmoved ctid=1 reasonid=0 clid=2|clid=3") fall back to the fields of the first one
+	typedef std::function<void(const CResultRow &row)> NotifyCallback_t;
 
 	typedef std::function<void(boost::smatch &result)> EventCallback_t;
 	typedef tuple<boost::regex, EventCallback_t> EventTuple_t;
 
+private: //definitions
+	//lets the notify handler map be searched with a string_ref, without building a string
+	struct NotifyVerbHash
+	{
+		size_t operator()(boost::string_ref verb) const
+		{
+			return boost::hash_range(verb.begin(), verb.end());
+		}
+	};
+	struct NotifyVerbEqual
+	{
+		bool operator()(boost::string_ref lhs, boost::string_ref rhs) const
+		{
+			return lhs == rhs;
+		}
+	};
+	typedef boost::unordered_map<string, NotifyCallback_t,
+		NotifyVerbHash, NotifyVerbEqual> NotifyHandlerMap_t;
+
 private: //variables
 	asio::io_service m_IoService;
 	thread *m_IoThread = nullptr;
+	tcp::resolver m_Resolver;
 
-	tcp::socket m_Socket;
 	tcp::endpoint m_SocketDest;
-	atomic<bool> m_Connected;
 	unsigned short m_ServerPort = 9987;
 
-	asio::deadline_timer m_AliveTimer;
-
-	asio::streambuf m_ReadStreamBuf;
-	queue<string> m_CmdWriteBufferQueue;
-	boost::mutex m_CmdWriteBufferQueueMutex;
-
-	boost::mutex m_CmdQueueMutex;
-	queue<CmdTuple_t> m_CmdQueue;
-
+	//the first session is the primary one: it logs in first, owns the
+	//notify registrations and executes all session-bound commands;
+	//the other sessions only run routed commands
+	vector<CQuerySession *> m_Sessions;
+	bool m_WorkersStarted = false;
+	string m_LoginCmd;
+	ReadCallback_t m_LoginCallback;
+
+	//the flood protection counts all sessions from our IP together
+	CTokenBucket m_FloodControl;
+
+	atomic<CommandId_t> m_NextCommandId;
+	atomic<unsigned int> m_CommandTimeout; //milliseconds, 0 means none
+
+	NotifyHandlerMap_t m_NotifyHandlers;
+	//field storage of the notify rows (first entry, other entries), reused by every
+	//notify; all sessions call OnNotify from the network thread
+	vector<CResultRow::Field> m_NotifyFields[2];
+	//only used for notifies without a handler above
 	vector<EventTuple_t> m_EventList;
 
 
 private: //constructor / deconstructor
 	CNetwork() :
-		m_Socket(m_IoService),
-		m_Connected(false),
-		m_AliveTimer(m_IoService)
+		m_Resolver(m_IoService),
+		m_NextCommandId(1),
+		m_CommandTimeout(0)
 	{ }
 
 	~CNetwork()
@@ -76,7 +119,11 @@ private: //constructor / deconstructor
 
 
 public: //functions
-	bool Connect(string hostname, unsigned short port, unsigned short query_port = 10011);
+	//returns immediately, the hostname is resolved and the primary session
+	//connected in the background; failures are reported through TSC_OnConnectFailed,
+	//after which Connect() can be called again
+	bool Connect(string hostname, unsigned short port,
+		unsigned short query_port = 10011, unsigned int session_count = 1);
 	bool Disconnect();
 
 	inline unsigned short GetServerPort() const
@@ -85,28 +132,86 @@ public: //functions
 	}
 	inline bool IsConnected() const
 	{
-		return m_Connected;
+		return m_Sessions.empty() == false && m_Sessions.front()->IsConnected();
 	}
 
-	void Execute(string cmd, ReadCallback_t callback = ReadCallback_t());
+	//logs in the primary session as soon as it's connected; the other sessions
+	//connect and log in with the same credentials after that succeeded
+	//the callback is called again whenever the primary session
+	//logged in again after a lost connection; login and pass are unescaped
+	void Login(const string &login, const string &pass, ReadCallback_t callback);
+
+	//"timeout" is in milliseconds, 0 uses the default set with SetCommandTimeout
+	//"error_callback" is called instead of "callback" if the server answered
+	//with an error or the command timed out
+	//returns an id for Cancel()
+	CommandId_t Execute(string cmd, ReadCallback_t callback = ReadCallback_t(),
+		ECommandPriority priority = ECommandPriority::NORMAL, unsigned int timeout = 0,
+		ErrorCallback_t error_callback = ErrorCallback_t());
+	//for large list results: "row_callback" gets every row as soon as it was received,
+	//"callback" is called with an empty result set after the last one
+	//a command still without a response when the connection is lost is sent
+	//again after the reconnect, so rows might be passed twice
+	CommandId_t ExecuteStreamed(string cmd, RowCallback_t row_callback, ReadCallback_t callback,
+		ECommandPriority priority = ECommandPriority::NORMAL, unsigned int timeout = 0,
+		ErrorCallback_t error_callback = ErrorCallback_t());
+	//removes a command which wasn't sent yet
+	bool Cancel(CommandId_t id);
+	//runs "func" on the network thread, after the handlers which are already queued
+	inline void Post(std::function<void()> &&func)
+	{
+		m_IoService.post(std::move(func));
+	}
+	//runs "func" on the network thread once "delay" milliseconds passed
+	void Post(std::function<void()> &&func, unsigned int delay);
 
+	//commands not answered after this many milliseconds are reported with a
+	//TIMEOUT_ERROR and to their error callback; the session is reconnected,
+	//since the responses after a missing one can't be matched anymore
+	inline void SetCommandTimeout(unsigned int timeout)
+	{
+		m_CommandTimeout = timeout;
+	}
+
+	//maximum number of commands sent without having received their response yet
+	//the server answers commands in order, so responses are matched FIFO
+	bool SetPipelineDepth(unsigned int depth);
+
+	//time commands spent waiting in the queue before being sent, summed up over all sessions
+	QueueWaitStats GetQueueWaitStats(ECommandPriority priority);
+
+	inline CTokenBucket &GetFloodControl()
+	{
+		return m_FloodControl;
+	}
+
+	//"verb" is the first word of the notify, e.g. "notifyclientmoved"
+	inline void RegisterNotify(string verb, NotifyCallback_t &&callback)
+	{
+		m_NotifyHandlers[std::move(verb)] = std::move(callback);
+	}
+	//regex matched against the whole notify, for notifies RegisterNotify doesn't cover
 	inline void RegisterEvent(boost::regex &&event_rx, EventCallback_t &&callback)
 	{
 		m_EventList.push_back(boost::make_tuple(event_rx, callback));
 	}
 
 
-private: //handlers
-	void OnConnect(const boost::system::error_code &error_code);
-	void OnRead(const boost::system::error_code &error_code);
-	void OnWrite(const boost::system::error_code &error_code);
-
-	void NetAlive(const boost::system::error_code &error_code, bool from_write);
+private: //session handlers
+	void OnSessionConnected(CQuerySession &session);
+	void OnSessionLost(CQuerySession &session);
+	//the session couldn't connect or log in and won't try again
+	void OnSessionFailed(CQuerySession &session,
+		EErrorType error_type, unsigned int error_id, const string &error_msg);
+	void OnNotify(boost::string_ref notify_data);
 
 private: //functions
-	void AsyncRead();
-	void AsyncWrite(const string &data);
-	void AsyncConnect();
+	void OnResolve(const boost::system::error_code &error_code, tcp::resolver::iterator endpoint_it,
+		string hostname, unsigned short query_port);
+	CQuerySession *SelectSession(const string &cmd);
+	//closes a worker session for good, its commands are executed by the other sessions
+	void RetireSession(CQuerySession &session);
+	void LoginSession(CQuerySession &session);
 
 };
 
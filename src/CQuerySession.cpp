@@ -0,0 +1,1028 @@
+#include "main.hpp"
+#include "CQuerySession.hpp"
+#include "CNetwork.hpp"
+#include "CUtils.hpp"
+#include "CCallback.hpp"
+
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+#include <boost/regex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "format.h"
+
+
+void CQuerySession::NetAlive(const boost::system::error_code &error_code)
+{
+	if (error_code.value() != 0)
+		return;
+
+
+	//goes through the same write stage as the commands, so it can't interleave with them
+	if (m_Socket.is_open())
+		AsyncWrite("\n");
+
+	m_AliveTimer.expires_from_now(boost::posix_time::seconds(60));
+	m_AliveTimer.async_wait(
+		boost::bind(&CQuerySession::NetAlive, this, boost::asio::placeholders::error));
+}
+
+
+void CQuerySession::Connect(const tcp::endpoint &dest)
+{
+	m_SocketDest = dest;
+	m_Connected = false;
+	m_Ready = false;
+	m_Socket.async_connect(m_SocketDest, boost::bind(&CQuerySession::OnConnect, this, _1));
+}
+
+void CQuerySession::ScheduleReconnect()
+{
+	if (CanReconnect() == false)
+		return;
+
+	const unsigned int delay = m_ReconnectAttempts < 6
+		? std::min(1u << m_ReconnectAttempts, MaxReconnectDelay)
+		: MaxReconnectDelay;
+	m_ReconnectAttempts++;
+
+	m_ReconnectTimer.expires_from_now(boost::posix_time::seconds(delay));
+	m_ReconnectTimer.async_wait(
+		boost::bind(&CQuerySession::OnReconnectTimer, this, boost::asio::placeholders::error));
+}
+
+void CQuerySession::OnReconnectTimer(const boost::system::error_code &error_code)
+{
+	if (error_code.value() != 0 || m_IsClosed)
+		return;
+
+	boost::system::error_code ignored_error;
+	m_Socket.close(ignored_error);
+	m_Socket.async_connect(m_SocketDest, boost::bind(&CQuerySession::OnConnect, this, _1));
+}
+
+void CQuerySession::ResetConnection()
+{
+	m_Connected = false;
+	m_Ready = false;
+
+	boost::system::error_code ignored_error;
+	m_Socket.close(ignored_error);
+	m_AliveTimer.cancel();
+
+	//the responses to sent commands are lost with the connection, so they're
+	//sent again (before everything that's still waiting) once we're logged in again;
+	//setup commands are issued anew by the next login
+	boost::lock_guard<boost::mutex> queue_lock_guard(m_CmdQueueMutex);
+	deque<Command> resend;
+	while (m_SentCmdQueue.empty() == false)
+	{
+		Command &command = m_SentCmdQueue.front();
+		if (command.IsSetup == false)
+		{
+			if (command.Deadline != TimePoint_t::max())
+				ArmDeadlineTimer(command.Deadline);
+			SplitBatch(boost::move(command), resend);
+		}
+		m_SentCmdQueue.pop();
+	}
+	m_RetryQueue.insert(m_RetryQueue.begin(),
+		std::make_move_iterator(resend.begin()), std::make_move_iterator(resend.end()));
+	m_SetupQueue.clear();
+
+	m_ReadBegin = m_ReadEnd = m_ReadScanned = 0;
+	ClearResult();
+	m_LastNotify.clear();
+
+	boost::lock_guard<boost::mutex> write_lock_guard(m_WriteMutex);
+	m_WritePending.clear();
+}
+
+void CQuerySession::Quit()
+{
+	if (IsConnected() == false)
+		return;
+
+	m_IsClosed = true; //don't reconnect when the server closes the connection
+	ReadCallback_t callback = [this](ResultSet_t &res)
+	{
+		m_Connected = false;
+		m_Ready = false;
+	};
+
+	//a session which isn't logged in yet only sends setup commands
+	if (IsReady())
+		Execute("quit", boost::move(callback), ECommandPriority::BACKGROUND);
+	else
+		ExecuteSetup("quit", boost::move(callback));
+}
+
+void CQuerySession::Close()
+{
+	m_IsClosed = true;
+	m_Connected = false;
+	m_Ready = false;
+	m_Socket.close();
+	m_AliveTimer.cancel();
+	m_ThrottleTimer.cancel();
+	m_ReconnectTimer.cancel();
+	m_DeadlineTimer.cancel();
+}
+
+void CQuerySession::SetReady(bool ready)
+{
+	boost::lock_guard<boost::mutex> queue_lock_guard(m_CmdQueueMutex);
+	m_Ready = ready;
+	if (ready)
+	{
+		m_WasReady = true;
+		m_ReconnectAttempts = 0;
+		SendPendingCommands();
+	}
+}
+
+void CQuerySession::AsyncRead()
+{
+	if (m_ReadBegin == m_ReadEnd)
+		m_ReadBegin = m_ReadEnd = m_ReadScanned = 0;
+
+	//make room for the next chunk, the unfinished line moves to the front
+	if (m_ReadBuffer.size() - m_ReadEnd < ReadChunkSize)
+	{
+		if (m_ReadBegin != 0)
+		{
+			std::memmove(m_ReadBuffer.data(), m_ReadBuffer.data() + m_ReadBegin, m_ReadEnd - m_ReadBegin);
+			m_ReadEnd -= m_ReadBegin;
+			m_ReadScanned -= m_ReadBegin;
+			m_ReadBegin = 0;
+		}
+		//a single line can be bigger than the buffer (e.g. "clientlist" on a full server)
+		if (m_ReadBuffer.size() - m_ReadEnd < ReadChunkSize)
+			m_ReadBuffer.resize(std::max(m_ReadBuffer.size() * 2, m_ReadEnd + ReadChunkSize));
+	}
+
+	m_Socket.async_read_some(
+		asio::buffer(m_ReadBuffer.data() + m_ReadEnd, m_ReadBuffer.size() - m_ReadEnd),
+		boost::bind(&CQuerySession::OnRead, this, _1, _2));
+}
+
+void CQuerySession::AsyncWrite(const string &data)
+{
+	boost::lock_guard<boost::mutex> lock_guard(m_WriteMutex);
+
+	m_WritePending.push_back(data);
+	string &cmd_write_buffer = m_WritePending.back();
+
+	if (cmd_write_buffer.empty() || cmd_write_buffer.back() != '\n')
+		cmd_write_buffer.push_back('\n');
+
+	//only one write at a time, everything queued meanwhile goes out with the next one;
+	//the write itself is always started from the io thread
+	if (m_IsWriting == false)
+	{
+		m_IsWriting = true;
+		m_IoService.post(boost::bind(&CQuerySession::StartWrite, this));
+	}
+}
+
+void CQuerySession::StartWrite()
+{
+	boost::lock_guard<boost::mutex> lock_guard(m_WriteMutex);
+	if (m_WritePending.empty())
+	{
+		m_IsWriting = false;
+		return;
+	}
+
+	m_WriteInFlight.swap(m_WritePending);
+
+	vector<asio::const_buffer> buffers;
+	buffers.reserve(m_WriteInFlight.size());
+	for (auto &b : m_WriteInFlight)
+		buffers.push_back(asio::buffer(b));
+
+	asio::async_write(m_Socket, buffers,
+		boost::bind(&CQuerySession::OnWrite, this, _1));
+}
+
+void CQuerySession::OnConnect(const boost::system::error_code &error_code)
+{
+	if (error_code.value() == 0)
+	{
+		m_Connected = true;
+
+		//pipelined commands are small writes sent while earlier ones still wait for
+		//their response, Nagle's algorithm would hold them back until an ACK arrives
+		boost::system::error_code ignored_error;
+		m_Socket.set_option(tcp::no_delay(true), ignored_error);
+
+		AsyncRead();
+
+		//start heartbeat check
+		NetAlive(boost::system::error_code());
+
+		m_Network.OnSessionConnected(*this);
+	}
+	else
+	{
+		if (error_code == asio::error::operation_aborted)
+			return;
+
+		string error_str(fmt::format("error while connecting to server: {}", error_code.message()));
+		CCallbackHandler::Get()->ForwardError(
+			EErrorType::CONNECTION_ERROR, error_code.value(), string(error_str));
+
+		if (CanReconnect())
+			m_Network.OnSessionLost(*this);
+		else
+			m_Network.OnSessionFailed(*this, EErrorType::CONNECTION_ERROR, error_code.value(), error_str);
+	}
+}
+
+
+/*
+	- result data is sent as a string which ends with "\n\r"
+	- the Teamspeak3 server can send multiple strings
+	- the end of a result set is always an error result string
+*/
+void CQuerySession::OnRead(const boost::system::error_code &error_code, size_t bytes_read)
+{
+	if (error_code.value() == 0)
+	{
+		m_ReadEnd += bytes_read;
+
+		//hand every complete line to the parser, straight out of the buffer
+		const char *buffer = m_ReadBuffer.data();
+		while (m_ReadScanned != m_ReadEnd)
+		{
+			const char *line_end = static_cast<const char *>(
+				std::memchr(buffer + m_ReadScanned, '\r', m_ReadEnd - m_ReadScanned));
+			if (line_end == nullptr)
+			{
+				m_ReadScanned = m_ReadEnd;
+				break;
+			}
+
+			boost::string_ref line(buffer + m_ReadBegin, line_end - (buffer + m_ReadBegin));
+			m_ReadBegin = m_ReadScanned = (line_end - buffer) + 1;
+			if (ProcessLine(line) == false)
+				return; //connection was reset
+		}
+
+		AsyncRead();
+	}
+	else //error
+	{
+		//errors after "quit" or Close() are expected
+		if (m_Connected == false)
+			return;
+
+		CCallbackHandler::Get()->ForwardError(
+			EErrorType::CONNECTION_ERROR, error_code.value(),
+			fmt::format("error while reading: {}", error_code.message()));
+
+		ResetConnection(); //we're not _really_ connected, are we?
+		m_Network.OnSessionLost(*this);
+	}
+}
+
+bool CQuerySession::ProcessLine(boost::string_ref line)
+{
+#ifdef _DEBUG
+	string dbg_read_data(line.data(), line.length());
+	bool first_line = true;
+	do
+	{
+		logprintf("%s> [%u] %s",
+			first_line == true ? ">>>" : "   ",
+			m_Id, dbg_read_data.substr(0, 512).c_str());
+		dbg_read_data.erase(0, 512);
+		first_line = false;
+	} while (dbg_read_data.empty() == false);
+#endif
+
+	//regex: parse error
+	//if this is an error message, it means that no other result data will come
+	static const boost::regex error_rx("error id=([0-9]+) msg=([^ \n]+)");
+	boost::cmatch error_rx_result;
+	if (line.starts_with("error ")
+		&& boost::regex_search(line.begin(), line.end(), error_rx_result, error_rx))
+	{
+		if (error_rx_result[1].str() == "0")
+		{
+			size_t row_begin = 0;
+			for (size_t row_end : m_ResultRowEnds)
+			{
+				m_ResultRows.push_back(boost::string_ref(
+					m_ResultArena.data() + row_begin, row_end - row_begin));
+				row_begin = row_end;
+			}
+
+			//call callback and send next command
+			m_CmdQueueMutex.lock();
+			if (m_SentCmdQueue.empty() == false)
+			{
+				Command command(boost::move(m_SentCmdQueue.front()));
+				m_SentCmdQueue.pop();
+
+				//refill the pipeline before the callback runs
+				SendPendingCommands();
+				m_CmdQueueMutex.unlock();
+
+				if (command.Callback)
+					command.Callback(m_ResultRows); //calls the callback
+				//every part of a batch gets the shared result
+				for (auto &p : command.BatchParts)
+				{
+					if (p.Callback)
+						p.Callback(m_ResultRows);
+				}
+			}
+			else
+				m_CmdQueueMutex.unlock();
+		}
+		else
+		{
+			string error_str(error_rx_result[2].str());
+			unsigned int error_id = 0;
+
+			CUtils::Get()->UnEscapeString(error_str);
+			CUtils::Get()->ConvertStringToInt(error_rx_result[1].str(), error_id);
+
+			bool setup_failed = false;
+			Command failed_command;
+			m_CmdQueueMutex.lock();
+			if (error_id == FloodErrorId && m_SentCmdQueue.empty() == false
+				&& m_SentCmdQueue.front().FloodRetries < MaxFloodRetries)
+			{
+				//"error id=524 msg=client\sis\sflooding extra_msg=please\swait\s5\sseconds"
+				static const boost::regex flood_wait_rx("extra_msg=please\\\\swait\\\\s([0-9]+)\\\\sseconds?");
+				boost::cmatch flood_wait_result;
+				unsigned int wait_seconds = 1;
+				if (boost::regex_search(line.begin(), line.end(), flood_wait_result, flood_wait_rx))
+					CUtils::Get()->ConvertStringToInt(flood_wait_result[1].str(), wait_seconds);
+
+				m_Network.GetFloodControl().OnFloodError(wait_seconds);
+
+				Command command(boost::move(m_SentCmdQueue.front()));
+				m_SentCmdQueue.pop();
+				command.FloodRetries++;
+				//a batch is split up again, so its parts can still be cancelled
+				SplitBatch(boost::move(command), m_RetryQueue);
+			}
+			else if (m_SentCmdQueue.empty() == false)
+			{
+				const Command &command = m_SentCmdQueue.front();
+				if (command.BatchParts.empty())
+				{
+					error_str = fmt::format("error while executing \"{}\": {}", command.Cmd, error_str);
+					CCallbackHandler::Get()->ForwardError(
+						EErrorType::TEAMSPEAK_ERROR, error_id, string(error_str));
+				}
+				else
+				{
+					for (auto &p : command.BatchParts)
+					{
+						CCallbackHandler::Get()->ForwardError(
+							EErrorType::TEAMSPEAK_ERROR, error_id,
+							fmt::format("error while executing \"{}\" (as \"{}\"): {}", p.Cmd, command.Cmd, error_str));
+					}
+				}
+
+				setup_failed = command.IsSetup;
+				failed_command = boost::move(m_SentCmdQueue.front());
+				m_SentCmdQueue.pop();
+			}
+			SendPendingCommands();
+			m_CmdQueueMutex.unlock();
+
+			//a streamed command would otherwise never learn that its result ended
+			CallErrorCallbacks(failed_command, EErrorType::TEAMSPEAK_ERROR, error_id);
+
+			if (setup_failed && CanReconnect())
+			{
+				//e.g. the virtual server isn't up yet after a restart, try again later
+				ResetConnection();
+				m_Network.OnSessionLost(*this);
+				return false;
+			}
+			else if (setup_failed && m_IsClosed == false)
+			{
+				//wrong login or server port, no point in retrying that
+				m_Network.OnSessionFailed(*this, EErrorType::TEAMSPEAK_ERROR, error_id, error_str);
+				return false;
+			}
+		}
+
+		ClearResult();
+	}
+	else if (line.starts_with("notify"))
+	{
+		if (IsDuplicateNotify(line) == false)
+			m_Network.OnNotify(line);
+	}
+	else
+	{
+		//stack the result data if it is not an error or notification message
+		CaptureResultLine(line);
+	}
+
+	return true;
+}
+
+void CQuerySession::CaptureResultLine(boost::string_ref line)
+{
+	while (line.empty() == false && (line.back() == '\n' || line.back() == '\r'))
+		line.remove_suffix(1);
+
+	if (m_IsCapturing == false)
+	{
+		m_IsCapturing = true;
+
+		boost::lock_guard<boost::mutex> queue_lock_guard(m_CmdQueueMutex);
+		if (m_SentCmdQueue.empty() == false)
+			m_RowCallback = m_SentCmdQueue.front().RowCallback;
+	}
+
+	//multiple rows are joined with '|', a literal '|' is escaped as "\p"
+	size_t delim_pos = 0;
+	do
+	{
+		delim_pos = line.find('|');
+		const boost::string_ref row = line.substr(0, delim_pos);
+		if (m_RowCallback)
+		{
+			m_RowCallback(row);
+		}
+		else
+		{
+			m_ResultArena.append(row.data(), row.length());
+			m_ResultRowEnds.push_back(m_ResultArena.length());
+		}
+
+		if (delim_pos != boost::string_ref::npos)
+			line.remove_prefix(delim_pos + 1);
+	} while (delim_pos != boost::string_ref::npos);
+}
+
+bool CQuerySession::IsDuplicateNotify(boost::string_ref line)
+{
+	//only the same bytes right after each other; with another notify in between
+	//(e.g. a client moved away and back) the repeat is a change of its own
+	const TimePoint_t now = boost::chrono::steady_clock::now();
+	if (now - m_LastNotifyTime < boost::chrono::milliseconds(NotifyWindowMs)
+		&& boost::string_ref(m_LastNotify) == line)
+	{
+		//the scopes send a notify at most twice, a third one is new again
+		m_LastNotify.clear();
+		return true;
+	}
+
+	//assign() reuses the capacity, so this doesn't allocate per notify
+	m_LastNotify.assign(line.data(), line.length());
+	m_LastNotifyTime = now;
+	return false;
+}
+
+void CQuerySession::ClearResult()
+{
+	m_IsCapturing = false;
+	m_RowCallback = RowCallback_t();
+
+	if (m_ResultArena.capacity() > MaxRetainedResultSize)
+	{
+		string().swap(m_ResultArena);
+		vector<size_t>().swap(m_ResultRowEnds);
+		ResultSet_t().swap(m_ResultRows);
+		return;
+	}
+
+	m_ResultArena.clear();
+	m_ResultRowEnds.clear();
+	m_ResultRows.clear();
+}
+
+void CQuerySession::OnWrite(const boost::system::error_code &error_code)
+{
+	boost::unique_lock<boost::mutex> lock(m_WriteMutex);
+#ifdef _DEBUG
+	for (auto &b : m_WriteInFlight)
+		logprintf("<<<< [%u] %s", m_Id, b.c_str());
+#endif
+	m_WriteInFlight.clear();
+	if (error_code.value() != 0 && m_Connected)
+	{
+		CCallbackHandler::Get()->ForwardError(
+			EErrorType::CONNECTION_ERROR, error_code.value(),
+			fmt::format("error while writing: {}", error_code.message()));
+	}
+	lock.unlock();
+
+	StartWrite();
+}
+
+void CQuerySession::Execute(string cmd, ReadCallback_t callback, ECommandPriority priority)
+{
+	Command command;
+	command.Cmd = boost::move(cmd);
+	command.Callback = boost::move(callback);
+	command.Priority = priority;
+	command.QueueTime = boost::chrono::steady_clock::now();
+
+	Execute(boost::move(command));
+}
+
+void CQuerySession::Execute(Command &&command)
+{
+	boost::lock_guard<boost::mutex> queue_lock_guard(m_CmdQueueMutex);
+	if (command.Deadline != TimePoint_t::max())
+		ArmDeadlineTimer(command.Deadline);
+
+	m_CmdQueue[static_cast<size_t>(command.Priority)].push_back(boost::move(command));
+	SendPendingCommands();
+}
+
+bool CQuerySession::Cancel(CommandId_t id)
+{
+	if (id == 0)
+		return false;
+
+	auto erase_from = [id](deque<Command> &lane)
+	{
+		for (auto i = lane.begin(); i != lane.end(); ++i)
+		{
+			if (i->Id == id)
+			{
+				lane.erase(i);
+				return true;
+			}
+		}
+		return false;
+	};
+
+	boost::lock_guard<boost::mutex> queue_lock_guard(m_CmdQueueMutex);
+	if (erase_from(m_RetryQueue))
+		return true;
+	for (auto &lane : m_CmdQueue)
+	{
+		if (erase_from(lane))
+			return true;
+	}
+	return false;
+}
+
+void CQuerySession::ExecuteSetup(string cmd, ReadCallback_t callback)
+{
+	Command command;
+	command.Cmd = boost::move(cmd);
+	command.Callback = boost::move(callback);
+	command.Priority = ECommandPriority::INTERACTIVE;
+	command.QueueTime = boost::chrono::steady_clock::now();
+	command.IsSetup = true;
+
+	boost::lock_guard<boost::mutex> queue_lock_guard(m_CmdQueueMutex);
+	m_SetupQueue.push_back(boost::move(command));
+	SendPendingCommands();
+}
+
+bool CQuerySession::SetPipelineDepth(unsigned int depth)
+{
+	if (depth == 0)
+		return false;
+
+	boost::lock_guard<boost::mutex> queue_lock_guard(m_CmdQueueMutex);
+	m_PipelineDepth = depth;
+	SendPendingCommands();
+	return true;
+}
+
+size_t CQuerySession::GetOutstandingCount()
+{
+	boost::lock_guard<boost::mutex> queue_lock_guard(m_CmdQueueMutex);
+	size_t count = m_SentCmdQueue.size() + m_RetryQueue.size();
+	for (auto &lane : m_CmdQueue)
+		count += lane.size();
+	return count;
+}
+
+void CQuerySession::TakePendingCommands(queue<Command> &dest)
+{
+	boost::lock_guard<boost::mutex> queue_lock_guard(m_CmdQueueMutex);
+	while (m_RetryQueue.empty() == false)
+	{
+		dest.push(boost::move(m_RetryQueue.front()));
+		m_RetryQueue.pop_front();
+	}
+	for (auto &lane : m_CmdQueue)
+	{
+		while (lane.empty() == false)
+		{
+			dest.push(boost::move(lane.front()));
+			lane.pop_front();
+		}
+	}
+}
+
+CQuerySession::QueueWaitStats CQuerySession::GetQueueWaitStats(ECommandPriority priority)
+{
+	boost::lock_guard<boost::mutex> queue_lock_guard(m_CmdQueueMutex);
+	return m_QueueWaitStats[static_cast<size_t>(priority)];
+}
+
+void CQuerySession::SendPendingCommands()
+{
+	if (m_IsThrottled || m_Connected == false)
+		return;
+
+	while (m_SentCmdQueue.size() < m_PipelineDepth && HasWaitingCommands())
+	{
+		CTokenBucket::Clock_t::duration wait;
+		if (m_Network.GetFloodControl().TryConsume(wait) == false)
+		{
+			//continue as soon as the next token is available
+			m_IsThrottled = true;
+			m_ThrottleTimer.expires_from_now(boost::posix_time::microseconds(
+				boost::chrono::duration_cast<boost::chrono::microseconds>(wait).count() + 1));
+			m_ThrottleTimer.async_wait(
+				boost::bind(&CQuerySession::OnThrottleTimer, this, boost::asio::placeholders::error));
+			break;
+		}
+
+		deque<Command> *lane = SelectLane();
+		CoalesceFrontCommand(*lane);
+
+		Command &command = lane->front();
+		const unsigned long long wait_time = boost::chrono::duration_cast<boost::chrono::microseconds>(
+			boost::chrono::steady_clock::now() - command.QueueTime).count();
+		QueueWaitStats &stats = m_QueueWaitStats[static_cast<size_t>(command.Priority)];
+		stats.Commands++;
+		stats.TotalWaitUs += wait_time;
+		if (wait_time > stats.MaxWaitUs)
+			stats.MaxWaitUs = wait_time;
+
+		m_SentCmdQueue.push(boost::move(command));
+		lane->pop_front();
+		AsyncWrite(m_SentCmdQueue.back().Cmd);
+	}
+}
+
+bool CQuerySession::HasWaitingCommands() const
+{
+	if (m_SetupQueue.empty() == false)
+		return true;
+
+	if (m_Ready == false)
+		return false;
+
+	if (m_RetryQueue.empty() == false)
+		return true;
+
+	for (auto &lane : m_CmdQueue)
+	{
+		if (lane.empty() == false)
+			return true;
+	}
+	return false;
+}
+
+void CQuerySession::ArmDeadlineTimer(TimePoint_t deadline)
+{
+	if (deadline >= m_DeadlineTimerExpiry)
+		return;
+
+	m_DeadlineTimerExpiry = deadline;
+
+	const TimePoint_t now = boost::chrono::steady_clock::now();
+	const long long wait_us = deadline > now
+		? boost::chrono::duration_cast<boost::chrono::microseconds>(deadline - now).count()
+		: 0;
+	m_DeadlineTimer.expires_from_now(boost::posix_time::microseconds(wait_us + 1));
+	m_DeadlineTimer.async_wait(
+		boost::bind(&CQuerySession::OnDeadlineTimer, this, boost::asio::placeholders::error));
+}
+
+void CQuerySession::OnDeadlineTimer(const boost::system::error_code &error_code)
+{
+	if (error_code.value() != 0)
+		return;
+
+	const TimePoint_t now = boost::chrono::steady_clock::now();
+	TimePoint_t next_deadline = TimePoint_t::max();
+	bool stalled = false;
+
+	m_CmdQueueMutex.lock();
+	m_DeadlineTimerExpiry = TimePoint_t::max();
+
+	//commands which weren't sent in time are dropped
+	vector<Command> expired;
+	auto expire = [&](deque<Command> &lane)
+	{
+		for (auto i = lane.begin(); i != lane.end(); )
+		{
+			if (i->Deadline <= now)
+			{
+				CCallbackHandler::Get()->ForwardError(
+					EErrorType::TIMEOUT_ERROR, i->Id,
+					fmt::format("command \"{}\" timed out while queued", i->Cmd));
+				expired.push_back(boost::move(*i));
+				i = lane.erase(i);
+			}
+			else
+			{
+				next_deadline = std::min(next_deadline, i->Deadline);
+				++i;
+			}
+		}
+	};
+	expire(m_RetryQueue);
+	for (auto &lane : m_CmdQueue)
+		expire(lane);
+
+	//the server didn't answer the oldest command in time, every response
+	//after it is blocked too
+	if (m_SentCmdQueue.empty() == false)
+	{
+		Command &command = m_SentCmdQueue.front();
+		if (command.Deadline <= now)
+		{
+			if (command.BatchParts.empty())
+			{
+				CCallbackHandler::Get()->ForwardError(
+					EErrorType::TIMEOUT_ERROR, command.Id,
+					fmt::format("no response to command \"{}\"", command.Cmd));
+			}
+			for (auto &p : command.BatchParts)
+			{
+				CCallbackHandler::Get()->ForwardError(
+					EErrorType::TIMEOUT_ERROR, p.Id,
+					fmt::format("no response to command \"{}\" (as \"{}\")", p.Cmd, command.Cmd));
+			}
+
+			//responses are matched in order, so a late one would be passed to the
+			//wrong command; the connection is dropped and the commands sent after
+			//this one are sent again on the new connection (see ResetConnection)
+			expired.push_back(boost::move(command));
+			m_SentCmdQueue.pop();
+			stalled = true;
+		}
+	}
+	if (stalled == false && m_SentCmdQueue.empty() == false)
+		next_deadline = std::min(next_deadline, m_SentCmdQueue.front().Deadline);
+
+	if (next_deadline != TimePoint_t::max())
+		ArmDeadlineTimer(next_deadline);
+
+	if (stalled == false)
+		SendPendingCommands();
+	m_CmdQueueMutex.unlock();
+
+	if (stalled)
+		ResetConnection();
+
+	for (auto &command : expired)
+		CallErrorCallbacks(command, EErrorType::TIMEOUT_ERROR, 0);
+
+	if (stalled)
+	{
+		if (CanReconnect())
+			m_Network.OnSessionLost(*this);
+		else if (m_IsClosed == false)
+			m_Network.OnSessionFailed(*this, EErrorType::TIMEOUT_ERROR, 0, "no response from the server");
+	}
+}
+
+void CQuerySession::OnThrottleTimer(const boost::system::error_code &error_code)
+{
+	if (error_code.value() != 0)
+		return;
+
+	boost::lock_guard<boost::mutex> queue_lock_guard(m_CmdQueueMutex);
+	m_IsThrottled = false;
+	SendPendingCommands();
+}
+
+deque<CQuerySession::Command> *CQuerySession::SelectLane()
+{
+	if (m_SetupQueue.empty() == false)
+		return &m_SetupQueue;
+
+	//retried commands were sent before everything that's still waiting
+	if (m_RetryQueue.empty() == false)
+		return &m_RetryQueue;
+
+	size_t selected = NumPriorities;
+
+	//a lane which was passed over too often gets its turn first
+	for (size_t l = 0; l != NumPriorities; ++l)
+	{
+		if (m_CmdQueue[l].empty() == false && m_LaneSkips[l] >= StarvationLimit)
+		{
+			selected = l;
+			break;
+		}
+	}
+
+	if (selected == NumPriorities)
+	{
+		for (size_t l = 0; l != NumPriorities; ++l)
+		{
+			if (m_CmdQueue[l].empty() == false)
+			{
+				selected = l;
+				break;
+			}
+		}
+	}
+
+	if (selected == NumPriorities)
+		return nullptr;
+
+	for (size_t l = 0; l != NumPriorities; ++l)
+	{
+		if (l == selected || m_CmdQueue[l].empty())
+			m_LaneSkips[l] = 0;
+		else if (l > selected)
+			m_LaneSkips[l]++;
+	}
+	return &m_CmdQueue[selected];
+}
+
+
+/*
+	some commands accept several targets joined with '|', e.g.
+	"clientmove clid=1|clid=2|clid=3 cid=5"
+	splits such a command up into its name, its target parameter and
+	all other parameters (with leading space each)
+*/
+static bool ParseBatchableCommand(const string &cmd,
+	string &name, string &target, string &args)
+{
+	static const vector<tuple<string, string>> batchable_cmds{
+		boost::make_tuple("clientmove", "clid="),
+		boost::make_tuple("clientkick", "clid="),
+		boost::make_tuple("servergroupaddclient", "cldbid="),
+		boost::make_tuple("servergroupdelclient", "cldbid=")
+	};
+
+	if (cmd.find('|') != string::npos)
+		return false;
+
+	const size_t name_end = cmd.find(' ');
+	if (name_end == string::npos)
+		return false;
+
+	name = cmd.substr(0, name_end);
+	const string *target_field = nullptr;
+	for (auto &c : batchable_cmds)
+	{
+		if (c.get<0>() == name)
+		{
+			target_field = &c.get<1>();
+			break;
+		}
+	}
+	if (target_field == nullptr)
+		return false;
+
+	target.clear();
+	args.clear();
+	size_t param_pos = name_end + 1;
+	while (param_pos < cmd.length())
+	{
+		size_t param_end = cmd.find(' ', param_pos);
+		if (param_end == string::npos)
+			param_end = cmd.length();
+
+		if (cmd.compare(param_pos, target_field->length(), *target_field) == 0)
+		{
+			if (target.empty() == false)
+				return false;
+			target = cmd.substr(param_pos, param_end - param_pos);
+		}
+		else if (param_end != param_pos)
+		{
+			args.push_back(' ');
+			args.append(cmd, param_pos, param_end - param_pos);
+		}
+		param_pos = param_end + 1;
+	}
+	return target.empty() == false;
+}
+
+void CQuerySession::CoalesceFrontCommand(deque<Command> &lane)
+{
+	static const size_t max_batch_size = 64;
+
+	string name, target, args;
+	if (lane.front().RowCallback
+		|| ParseBatchableCommand(lane.front().Cmd, name, target, args) == false)
+		return;
+
+
+	vector<string> batch_targets{ target };
+	vector<BatchPart> batch_parts;
+	TimePoint_t batch_deadline = lane.front().Deadline;
+	vector<string> skipped_targets;
+
+	auto take_part = [&batch_parts](Command &command)
+	{
+		BatchPart part;
+		part.Id = command.Id;
+		part.Cmd = boost::move(command.Cmd);
+		part.Callback = boost::move(command.Callback);
+		part.ErrorCallback = boost::move(command.ErrorCallback);
+		part.Deadline = command.Deadline;
+		batch_parts.push_back(boost::move(part));
+	};
+
+	auto has_target = [](const vector<string> &targets, const string &t)
+	{
+		return std::find(targets.begin(), targets.end(), t) != targets.end();
+	};
+
+	//only commands of the same kind may be pulled in front of each other,
+	//and never in front of an earlier command for the same target
+	string cmd_name, cmd_target, cmd_args;
+	for (auto i = lane.begin() + 1;
+		i != lane.end() && batch_targets.size() < max_batch_size; )
+	{
+		if (i->RowCallback
+			|| ParseBatchableCommand(i->Cmd, cmd_name, cmd_target, cmd_args) == false
+			|| cmd_name != name)
+			break;
+
+		if (cmd_args == args
+			&& has_target(batch_targets, cmd_target) == false
+			&& has_target(skipped_targets, cmd_target) == false)
+		{
+			if (batch_parts.empty())
+				take_part(lane.front());
+			take_part(*i);
+			batch_targets.push_back(cmd_target);
+			batch_deadline = std::min(batch_deadline, i->Deadline);
+			i = lane.erase(i);
+		}
+		else
+		{
+			skipped_targets.push_back(cmd_target);
+			++i;
+		}
+	}
+
+	if (batch_targets.size() == 1)
+		return;
+
+
+	string batch_cmd(name);
+	for (size_t t = 0; t != batch_targets.size(); ++t)
+	{
+		batch_cmd.push_back(t == 0 ? ' ' : '|');
+		batch_cmd.append(batch_targets.at(t));
+	}
+	batch_cmd.append(args);
+
+	//the front command becomes the batch, its own id, command and callback are part 0
+	Command &batch = lane.front();
+	batch.Id = 0;
+	batch.Cmd = boost::move(batch_cmd);
+	batch.Deadline = batch_deadline;
+	//the moved-from callbacks are in an unspecified state, the batch itself has none
+	batch.Callback = ReadCallback_t();
+	batch.ErrorCallback = ErrorCallback_t();
+	batch.BatchParts = boost::move(batch_parts);
+}
+
+void CQuerySession::SplitBatch(Command &&command, deque<Command> &dest)
+{
+	if (command.BatchParts.empty())
+	{
+		dest.push_back(boost::move(command));
+		return;
+	}
+
+	for (auto &p : command.BatchParts)
+	{
+		Command part;
+		part.Id = p.Id;
+		part.Cmd = boost::move(p.Cmd);
+		part.Callback = boost::move(p.Callback);
+		part.ErrorCallback = boost::move(p.ErrorCallback);
+		part.Priority = command.Priority;
+		part.QueueTime = command.QueueTime;
+		part.Deadline = p.Deadline;
+		part.FloodRetries = command.FloodRetries;
+		dest.push_back(boost::move(part));
+	}
+}
+
+void CQuerySession::CallErrorCallbacks(Command &command, EErrorType type, unsigned int error_id)
+{
+	if (command.ErrorCallback)
+		command.ErrorCallback(type, error_id);
+	for (auto &p : command.BatchParts)
+	{
+		if (p.ErrorCallback)
+			p.ErrorCallback(type, error_id);
+	}
+}
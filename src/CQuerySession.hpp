@@ -0,0 +1,276 @@
+#pragma once
+#ifndef INC_CQUERYSESSION_H
+#define INC_CQUERYSESSION_H
+
+
+#include <vector>
+#include <queue>
+#include <deque>
+#include <string>
+#include <functional>
+#include <boost/thread/mutex.hpp>
+#include <boost/asio.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/atomic.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/utility/string_ref.hpp>
+
+using std::vector;
+using std::queue;
+using std::deque;
+using std::string;
+namespace asio = boost::asio;
+using asio::ip::tcp;
+using boost::tuple;
+using boost::atomic;
+
+class CNetwork;
+enum class EErrorType;
+
+
+enum class ECommandPriority
+{
+	INTERACTIVE,
+	NORMAL,
+	BACKGROUND
+};
+
+
+//a single ServerQuery connection with its own command queue
+class CQuerySession
+{
+public: //definitions
+	//one row per entry, the views are only valid while the callback runs
+	typedef vector<boost::string_ref> ResultSet_t;
+	typedef std::function<void(ResultSet_t &)> ReadCallback_t;
+	//gets every row as soon as it was received, the view is only valid during the call
+	typedef std::function<void(boost::string_ref row)> RowCallback_t;
+	//called instead of the callback if the command failed, after the error was forwarded;
+	//"error_id" is the Teamspeak error id, 0 for a timeout
+	typedef std::function<void(EErrorType type, unsigned int error_id)> ErrorCallback_t;
+	typedef unsigned int CommandId_t; //0 is invalid
+	typedef boost::chrono::steady_clock::time_point TimePoint_t;
+
+	//one of the commands a batch was made of (see CoalesceFrontCommand)
+	struct BatchPart
+	{
+		CommandId_t Id;
+		string Cmd;
+		ReadCallback_t Callback;
+		ErrorCallback_t ErrorCallback;
+		TimePoint_t Deadline;
+	};
+
+	struct Command
+	{
+		CommandId_t Id = 0;
+		string Cmd;
+		ReadCallback_t Callback;
+		//if set, rows are passed to this instead of being collected,
+		//"Callback" then only signals the end of the result with an empty set
+		RowCallback_t RowCallback;
+		ErrorCallback_t ErrorCallback;
+		ECommandPriority Priority = ECommandPriority::NORMAL;
+		TimePoint_t QueueTime;
+		TimePoint_t Deadline = TimePoint_t::max(); //no response until then means timeout
+		unsigned int FloodRetries = 0;
+		bool IsSetup = false; //"use"/"login", sent before the session is ready
+		//set for a batch only, which reports its result and errors to every part
+		vector<BatchPart> BatchParts;
+	};
+
+	struct QueueWaitStats
+	{
+		unsigned long long
+			Commands = 0,
+			TotalWaitUs = 0,
+			MaxWaitUs = 0;
+	};
+
+	static const size_t NumPriorities = 3;
+	//a lane passed over this often for a higher priority lane is served next
+	static const unsigned int StarvationLimit = 4;
+
+	//"client is flooding", the command is retried after the server-given delay
+	static const unsigned int FloodErrorId = 524;
+	static const unsigned int MaxFloodRetries = 3;
+
+	//reconnect delay doubles with every failed attempt, up to this
+	static const unsigned int MaxReconnectDelay = 60;
+
+	//minimum free space for a single read, the buffer grows if a line doesn't fit
+	static const size_t ReadChunkSize = 16384;
+
+	//the result arena is reset after every response, but only keeps
+	//its memory if it didn't grow above this for a huge one
+	static const size_t MaxRetainedResultSize = 1024 * 1024;
+
+	//overlapping servernotifyregister scopes send some notifies twice in a row,
+	//a repeat of the previous notify within NotifyWindowMs is dropped
+	static const unsigned int NotifyWindowMs = 50;
+
+private: //variables
+	CNetwork &m_Network;
+	asio::io_service &m_IoService;
+	const unsigned int m_Id;
+
+	tcp::socket m_Socket;
+	tcp::endpoint m_SocketDest;
+	atomic<bool> m_Connected;
+	atomic<bool> m_Ready;
+	atomic<bool> m_WasReady; //logged in at least once, so worth reconnecting
+	atomic<bool> m_IsClosed;
+
+	asio::deadline_timer m_ReconnectTimer;
+	unsigned int m_ReconnectAttempts = 0;
+
+	asio::deadline_timer m_AliveTimer;
+	asio::deadline_timer m_ThrottleTimer;
+	bool m_IsThrottled = false;
+
+	//fires at the earliest deadline of all queued and sent commands
+	asio::deadline_timer m_DeadlineTimer;
+	TimePoint_t m_DeadlineTimerExpiry = TimePoint_t::max();
+
+	//received data, lines are parsed in place; [m_ReadBegin, m_ReadEnd) is
+	//unprocessed and [m_ReadBegin, m_ReadScanned) known to contain no '\r'
+	vector<char> m_ReadBuffer;
+	size_t
+		m_ReadBegin = 0,
+		m_ReadEnd = 0,
+		m_ReadScanned = 0;
+	//commands and keepalives are written in order, one gathered write at a time
+	vector<string>
+		m_WritePending,
+		m_WriteInFlight;
+	bool m_IsWriting = false;
+	boost::mutex m_WriteMutex;
+
+	boost::mutex m_CmdQueueMutex;
+	deque<Command> m_CmdQueue[NumPriorities]; //commands waiting to be sent, one lane per priority
+	unsigned int m_LaneSkips[NumPriorities] = { };
+	QueueWaitStats m_QueueWaitStats[NumPriorities];
+	deque<Command> m_SetupQueue; //session setup, the only commands sent while not ready
+	//commands rejected for flooding or sent on a lost connection, sent before all others
+	deque<Command> m_RetryQueue;
+	queue<Command> m_SentCmdQueue; //commands sent, waiting for their response
+	unsigned int m_PipelineDepth = 1;
+
+	//rows of the response currently being received, stored back to back;
+	//the views are built when it's complete, as the arena may move until then
+	string m_ResultArena;
+	vector<size_t> m_ResultRowEnds;
+	ResultSet_t m_ResultRows;
+	bool m_IsCapturing = false; //received rows of the current response already
+	RowCallback_t m_RowCallback; //of the command the current response belongs to
+	string m_LastNotify; //empty after a dropped repeat
+	TimePoint_t m_LastNotifyTime;
+
+
+public: //constructor / deconstructor
+	CQuerySession(CNetwork &network, asio::io_service &io_service, unsigned int id) :
+		m_Network(network),
+		m_IoService(io_service),
+		m_Id(id),
+		m_Socket(io_service),
+		m_Connected(false),
+		m_Ready(false),
+		m_WasReady(false),
+		m_IsClosed(false),
+		m_ReconnectTimer(io_service),
+		m_AliveTimer(io_service),
+		m_ThrottleTimer(io_service),
+		m_DeadlineTimer(io_service)
+	{ }
+	~CQuerySession() = default;
+	CQuerySession(const CQuerySession &rhs) = delete;
+
+
+public: //functions
+	void Connect(const tcp::endpoint &dest);
+	void Quit();
+	void Close();
+
+	inline bool CanReconnect() const
+	{
+		return m_WasReady && m_IsClosed == false;
+	}
+	//closed for good, won't send anything anymore
+	inline bool IsClosed() const
+	{
+		return m_IsClosed;
+	}
+	//tries to connect again after an exponentially growing delay
+	void ScheduleReconnect();
+
+	inline unsigned int GetId() const
+	{
+		return m_Id;
+	}
+	inline bool IsConnected() const
+	{
+		return m_Connected;
+	}
+	//logged in and ready to take commands
+	inline bool IsReady() const
+	{
+		return m_Ready;
+	}
+	void SetReady(bool ready);
+
+	void Execute(string cmd, ReadCallback_t callback = ReadCallback_t(),
+		ECommandPriority priority = ECommandPriority::NORMAL);
+	void Execute(Command &&command);
+	//removes a command which wasn't sent yet, its callback is never called
+	bool Cancel(CommandId_t id);
+	//queues a command needed to set up the session ("use", "login")
+	void ExecuteSetup(string cmd, ReadCallback_t callback = ReadCallback_t());
+	bool SetPipelineDepth(unsigned int depth);
+
+	//number of queued and in-flight commands
+	size_t GetOutstandingCount();
+	//removes all commands which weren't sent yet
+	void TakePendingCommands(queue<Command> &dest);
+	QueueWaitStats GetQueueWaitStats(ECommandPriority priority);
+
+
+private: //handlers
+	void OnConnect(const boost::system::error_code &error_code);
+	void OnRead(const boost::system::error_code &error_code, size_t bytes_read);
+	void OnWrite(const boost::system::error_code &error_code);
+
+	void NetAlive(const boost::system::error_code &error_code);
+	void OnThrottleTimer(const boost::system::error_code &error_code);
+	void OnReconnectTimer(const boost::system::error_code &error_code);
+	void OnDeadlineTimer(const boost::system::error_code &error_code);
+
+private: //functions
+	void AsyncRead();
+	void AsyncWrite(const string &data);
+	void StartWrite();
+	//returns false if the line caused the connection to be reset
+	bool ProcessLine(boost::string_ref line);
+	//splits a result line into its '|'-separated rows
+	void CaptureResultLine(boost::string_ref line);
+	void ClearResult();
+	//returns true if the notify repeats the previous one, remembers it otherwise
+	bool IsDuplicateNotify(boost::string_ref line);
+	//drops everything belonging to the lost connection, unanswered commands are sent again
+	void ResetConnection();
+	//runs the error callback of the command or of every part of a batch;
+	//m_CmdQueueMutex must not be locked, the callbacks might queue new commands
+	static void CallErrorCallbacks(Command &command, EErrorType type, unsigned int error_id);
+
+	//these require m_CmdQueueMutex to be locked
+	void SendPendingCommands();
+	bool HasWaitingCommands() const;
+	deque<Command> *SelectLane();
+	void CoalesceFrontCommand(deque<Command> &lane);
+	//appends the commands a batch was made of to "dest", any other command as it is
+	static void SplitBatch(Command &&command, deque<Command> &dest);
+	void ArmDeadlineTimer(TimePoint_t deadline);
+
+};
+
+
+#endif // INC_CQUERYSESSION_H
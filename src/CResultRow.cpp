@@ -0,0 +1,105 @@
+#include "CResultRow.hpp"
+
+
+CResultRow::CResultRow(Ref_t row, const CResultRow *shared_row) :
+	m_Fields(m_OwnFields),
+	m_SharedRow(shared_row)
+{
+	m_Fields.reserve(32);
+	Tokenize(row, [this](const Field &field)
+	{
+		m_Fields.push_back(field);
+	});
+}
+
+CResultRow::CResultRow(Ref_t row, vector<Field> &fields_buffer, const CResultRow *shared_row) :
+	m_Fields(fields_buffer),
+	m_SharedRow(shared_row)
+{
+	m_Fields.clear();
+	Tokenize(row, [this](const Field &field)
+	{
+		m_Fields.push_back(field);
+	});
+}
+
+const CResultRow::Field *CResultRow::Find(Ref_t key) const
+{
+	const size_t num_fields = m_Fields.size();
+	for (size_t n = 0; n != num_fields; ++n)
+	{
+		size_t idx = m_SearchHint + n;
+		if (idx >= num_fields)
+			idx -= num_fields;
+
+		if (m_Fields[idx].Key == key)
+		{
+			m_SearchHint = idx + 1 < num_fields ? idx + 1 : 0;
+			return &m_Fields[idx];
+		}
+	}
+	return m_SharedRow != nullptr ? m_SharedRow->Find(key) : nullptr;
+}
+
+bool CResultRow::Get(Ref_t key, Ref_t &dest) const
+{
+	const Field *field = Find(key);
+	if (field == nullptr || field->HasValue == false)
+		return false;
+
+	dest = field->Value;
+	return true;
+}
+
+bool CResultRow::Get(Ref_t key, string &dest) const
+{
+	Ref_t value;
+	if (Get(key, value) == false)
+		return false;
+
+	dest.assign(value.data(), value.length());
+	return true;
+}
+
+bool CResultRow::Get(Ref_t key, int &dest) const
+{
+	Ref_t value;
+	return Get(key, value) && ConvertToInt(value, dest);
+}
+
+bool CResultRow::Get(Ref_t key, unsigned int &dest) const
+{
+	Ref_t value;
+	return Get(key, value) && ConvertToInt(value, dest);
+}
+
+
+bool CResultRow::ConvertToInt(Ref_t input, unsigned int &output)
+{
+	if (input.empty())
+		return false;
+
+	unsigned int value = 0;
+	for (char c : input)
+	{
+		if (c < '0' || c > '9')
+			return false;
+		value = value * 10 + static_cast<unsigned int>(c - '0');
+	}
+	output = value;
+	return true;
+}
+
+bool CResultRow::ConvertToInt(Ref_t input, int &output)
+{
+	const bool negative = input.starts_with('-');
+	if (negative)
+		input.remove_prefix(1);
+
+	unsigned int value = 0;
+	if (ConvertToInt(input, value) == false)
+		return false;
+
+	output = negative ? -static_cast<int>(value) : static_cast<int>(value);
+	return true;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#ifndef INC_CRESULTROW_H
+#define INC_CRESULTROW_H
+
+
+#include <vector>
+#include <string>
+#include <boost/utility/string_ref.hpp>
+
+using std::vector;
+using std::string;
+
+
+//splits a "key=value key2=value2" row (result row or notify) into its fields once,
+//lookups are exact key matches; values stay escaped and point into the row,
+//so the row has to outlive this
+class CResultRow
+{
+public: //definitions
+	typedef boost::string_ref Ref_t;
+
+	struct Field
+	{
+		Ref_t
+			Key,
+			Value;
+		bool HasValue = false; //"key" without '=' (e.g. empty values or flags)
+	};
+
+private: //variables
+	vector<Field> m_OwnFields;
+	vector<Field> &m_Fields; //m_OwnFields or the buffer passed by the caller
+	//fields missing in this row are looked up here; in a multi-entry notify
+	//("clid=1|clid=2") the first entry holds the fields shared by all of them
+	const CResultRow *m_SharedRow = nullptr;
+	//fields are usually looked up in the order they appear in,
+	//so the search starts after the last field found
+	mutable size_t m_SearchHint = 0;
+
+
+public: //constructor / deconstructor
+	explicit CResultRow(Ref_t row, const CResultRow *shared_row = nullptr);
+	//stores the fields in "fields_buffer" instead, so a caller splitting row after row
+	//(e.g. the notifies) reuses its capacity; it's cleared and has to outlive the row
+	CResultRow(Ref_t row, vector<Field> &fields_buffer, const CResultRow *shared_row = nullptr);
+	explicit CResultRow(const string &row) :
+		CResultRow(Ref_t(row))
+	{ }
+	CResultRow(string &&row) = delete;
+	CResultRow(const CResultRow &) = delete;
+	CResultRow &operator=(const CResultRow &) = delete;
+	~CResultRow() = default;
+
+
+public: //functions
+	bool Has(Ref_t key) const
+	{
+		return Find(key) != nullptr;
+	}
+	bool Get(Ref_t key, Ref_t &dest) const;
+	bool Get(Ref_t key, string &dest) const;
+	bool Get(Ref_t key, int &dest) const;
+	bool Get(Ref_t key, unsigned int &dest) const;
+
+	inline const vector<Field> &GetFields() const
+	{
+		return m_Fields;
+	}
+	inline const CResultRow *GetSharedRow() const
+	{
+		return m_SharedRow;
+	}
+
+	//calls "func" with every field of "row", without storing them
+	template<typename F>
+	static void Tokenize(Ref_t row, F &&func)
+	{
+		const char
+			*i = row.data(),
+			*end = row.data() + row.length();
+		while (i != end)
+		{
+			if (*i == ' ' || *i == '\n' || *i == '\r')
+			{
+				++i;
+				continue;
+			}
+
+			Field field;
+			const char *token_start = i;
+			while (i != end && *i != ' ' && *i != '\n' && *i != '\r' && *i != '=')
+				++i;
+			field.Key = Ref_t(token_start, i - token_start);
+
+			if (i != end && *i == '=')
+			{
+				const char *value_start = ++i;
+				while (i != end && *i != ' ' && *i != '\n' && *i != '\r')
+					++i;
+				field.Value = Ref_t(value_start, i - value_start);
+				field.HasValue = true;
+			}
+			func(field);
+		}
+	}
+
+	static bool ConvertToInt(Ref_t input, int &output);
+	static bool ConvertToInt(Ref_t input, unsigned int &output);
+
+private: //functions
+	const Field *Find(Ref_t key) const;
+
+};
+
+
+#endif // INC_CRESULTROW_H
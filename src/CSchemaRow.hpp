@@ -0,0 +1,148 @@
+#pragma once
+#ifndef INC_CSCHEMAROW_H
+#define INC_CSCHEMAROW_H
+
+
+#include <array>
+#include <bitset>
+#include <string>
+#include <boost/utility/string_ref.hpp>
+
+#include "CResultRow.hpp"
+
+using std::string;
+
+
+//declares the fields of one notify or response type:
+//	#define TSC_CLIENTMOVED_FIELDS(FIELD) FIELD(ctid) FIELD(reasonid) FIELD(clid)
+//	TSC_DECLARE_SCHEMA(ClientMovedNotify, TSC_CLIENTMOVED_FIELDS)
+//every field becomes an enum value named like the field itself, so a
+//misspelled field name or a field of another schema fails to compile
+#define TSC_SCHEMA_FIELD_ENUM(name) name,
+#define TSC_SCHEMA_FIELD_NAME(name) boost::string_ref(#name, sizeof(#name) - 1),
+
+#define TSC_DECLARE_SCHEMA(schema_name, FIELDS) \
+	struct schema_name \
+	{ \
+		enum Field \
+		{ \
+			FIELDS(TSC_SCHEMA_FIELD_ENUM) \
+			NumFields \
+		}; \
+		static const boost::string_ref *GetNames() \
+		{ \
+			static const boost::string_ref names[NumFields] = { \
+				FIELDS(TSC_SCHEMA_FIELD_NAME) \
+			}; \
+			return names; \
+		} \
+	}
+
+
+//the fields of a row, as declared by "Schema"; the row is parsed once
+//without allocating and fields are accessed by array index
+//values stay escaped and point into the row, so the row has to outlive this
+template<typename Schema>
+class CSchemaRow
+{
+public: //definitions
+	typedef CResultRow::Ref_t Ref_t;
+	typedef typename Schema::Field Field_t;
+
+private: //variables
+	std::array<Ref_t, Schema::NumFields> m_Values;
+	std::bitset<Schema::NumFields>
+		m_IsPresent,
+		m_HasValue;
+	//the server mostly sends fields in the order they are declared in,
+	//so the name search starts after the last field found
+	unsigned int m_SearchHint = 0;
+
+
+public: //constructor / deconstructor
+	explicit CSchemaRow(Ref_t row)
+	{
+		CResultRow::Tokenize(row, [this](const CResultRow::Field &field)
+		{
+			Assign(field);
+		});
+	}
+	explicit CSchemaRow(const string &row) :
+		CSchemaRow(Ref_t(row))
+	{ }
+	CSchemaRow(string &&row) = delete;
+
+	//takes the fields of an already tokenized notify entry,
+	//including the ones shared with the first entry
+	explicit CSchemaRow(const CResultRow &row)
+	{
+		if (row.GetSharedRow() != nullptr)
+		{
+			for (auto &field : row.GetSharedRow()->GetFields())
+				Assign(field);
+			m_SearchHint = 0;
+		}
+		for (auto &field : row.GetFields())
+			Assign(field);
+	}
+	~CSchemaRow() = default;
+
+
+public: //functions
+	inline bool Has(Field_t field) const
+	{
+		return m_IsPresent.test(field);
+	}
+	inline bool Get(Field_t field, Ref_t &dest) const
+	{
+		if (m_HasValue.test(field) == false)
+			return false;
+
+		dest = m_Values[field];
+		return true;
+	}
+	bool Get(Field_t field, string &dest) const
+	{
+		Ref_t value;
+		if (Get(field, value) == false)
+			return false;
+
+		dest.assign(value.data(), value.length());
+		return true;
+	}
+	bool Get(Field_t field, int &dest) const
+	{
+		Ref_t value;
+		return Get(field, value) && CResultRow::ConvertToInt(value, dest);
+	}
+	bool Get(Field_t field, unsigned int &dest) const
+	{
+		Ref_t value;
+		return Get(field, value) && CResultRow::ConvertToInt(value, dest);
+	}
+
+private: //functions
+	void Assign(const CResultRow::Field &field)
+	{
+		const Ref_t *names = Schema::GetNames();
+		for (unsigned int n = 0; n != Schema::NumFields; ++n)
+		{
+			unsigned int idx = m_SearchHint + n;
+			if (idx >= Schema::NumFields)
+				idx -= Schema::NumFields;
+
+			if (names[idx] == field.Key)
+			{
+				m_IsPresent.set(idx);
+				m_HasValue.set(idx, field.HasValue);
+				m_Values[idx] = field.Value;
+				m_SearchHint = idx + 1 < Schema::NumFields ? idx + 1 : 0;
+				return;
+			}
+		}
+	}
+
+};
+
+
+#endif // INC_CSCHEMAROW_H
@@ -1,89 +1,66 @@
 #include "CServer.hpp"
+#include "CCacheFile.hpp"
 #include "CNetwork.hpp"
 #include "CUtils.hpp"
 #include "CCallback.hpp"
+#include "CResultRow.hpp"
+#include "CSchemaRow.hpp"
 
 #include "main.hpp"
 #include "format.h"
 
+#include <algorithm>
+#include <boost/chrono/ceil.hpp>
+
+
+CServer::~CServer()
+{
+	//runs on the game thread once CNetwork is gone, or on the network thread if
+	//the primary session was lost for good (see CNetwork::OnSessionLost), so only
+	//the cache itself is copied and the file is written by CCacheFile's own thread;
+	//only a complete cache is worth starting from
+	if (m_IsLoggedIn)
+		CCacheFile::Get()->Save(CopySnapshot());
+
+	//the callbacks still held back are about this cache
+	CCallbackHandler::Get()->ReleaseHeldCallbacks();
+}
 
 void CServer::Initialize()
 {
-	//register notify events
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifychannelcreated cid=([0-9]+) cpid=([0-9]+) channel_name=([^ ]+)(.+)invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ \n\r]+"),
+	//register notify events, dispatched by the notify name
+	CNetwork::Get()->RegisterNotify("notifychannelcreated",
 		boost::bind(&CServer::OnChannelCreated, this, _1));
 
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifychanneldeleted .+ cid=([0-9]+)"),
+	CNetwork::Get()->RegisterNotify("notifychanneldeleted",
 		boost::bind(&CServer::OnChannelDeleted, this, _1));
-	
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifychanneledited cid=([0-9]+) reasonid=10 invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ ]+ channel_order=([0-9]+)"),
-		boost::bind(&CServer::OnChannelReorder, this, _1));
 
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifychannelmoved cid=([0-9]+) cpid=([0-9]+) order=([0-9]+) reasonid=1 invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ \n\r]+"),
-		boost::bind(&CServer::OnChannelMoved, this, _1));
+	CNetwork::Get()->RegisterNotify("notifychanneledited",
+		boost::bind(&CServer::OnChannelEdited, this, _1));
 
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifychanneledited cid=([0-9]+) reasonid=10 invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ ]+ channel_name=([^ \n\r]+)"),
-		boost::bind(&CServer::OnChannelRenamed, this, _1));
-
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifychanneledited cid=([0-9]+) reasonid=10 invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ ]+ channel_flag_password=([01])"),
-		boost::bind(&CServer::OnChannelPasswordToggled, this, _1));
+	CNetwork::Get()->RegisterNotify("notifychannelmoved",
+		boost::bind(&CServer::OnChannelMoved, this, _1));
 
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifychannelpasswordchanged cid=([0-9]+)"),
+	CNetwork::Get()->RegisterNotify("notifychannelpasswordchanged",
 		boost::bind(&CServer::OnChannelPasswordChanged, this, _1));
 	//NOTE: always called if something with password changed, check if channel_flag_password was changed before fireing "pass-changed" callback
 
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifychanneledited cid=([0-9]+) reasonid=10 invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ ]+ (?:channel_flag_(permanent|semi_permanent)=([01]))(?: channel_flag_(permanent|semi_permanent)=([01]))?.*"),
-		boost::bind(&CServer::OnChannelTypeChanged, this, _1));
-	//DATA:
-	//	1: cid
-	//	2: flag name ("permanent", "semi_permanent")
-	//	3: flag status ("0", "1")
-	//	4: second flag name (optional)
-	//	5: second flag status (optional)
-
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifychanneledited cid=([0-9]+) reasonid=10 invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ ]+ channel_flag_default=1.*"),
-		boost::bind(&CServer::OnChannelSetDefault, this, _1));
-
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifychanneledited cid=([0-9]+) reasonid=10 invokerid=[0-9]+ invokername=[^ ]+ invokeruid=[^ ]+ channel_maxclients=([-0-9]+).*"),
-		boost::bind(&CServer::OnChannelMaxClientsChanged, this, _1));
-
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifychanneledited cid=([0-9]+) reasonid=10 invokerid=[0-9]+ .+ channel_needed_talk_power=([-0-9]+)"),
-		boost::bind(&CServer::OnChannelRequiredTalkPowerChanged, this, _1));
 
-
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifycliententerview cfid=0 ctid=([0-9]+) reasonid=0 clid=([0-9]+) client_unique_identifier=([^ ]+) client_nickname=([^ ]+) .+ client_database_id=([0-9]+) .+ client_type=([01]).*"),
+	CNetwork::Get()->RegisterNotify("notifycliententerview",
 		boost::bind(&CServer::OnClientConnect, this, _1));
 
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifyclientleftview cfid=[0-9]+ ctid=0(?: reasonid=([0-9]+).* reasonmsg(?:=([^ ]+))?.*)? clid=([0-9]+).*"),
+	CNetwork::Get()->RegisterNotify("notifyclientleftview",
 		boost::bind(&CServer::OnClientDisconnect, this, _1));
 
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifyclientmoved ctid=([0-9]+) reasonid=([0-9]+)(?: invokerid=([0-9]+))?.* (clid=.*)"),
+	CNetwork::Get()->RegisterNotify("notifyclientmoved",
 		boost::bind(&CServer::OnClientMoved, this, _1));
 
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifytextmessage targetmode=3 msg=([^ ]+) invokerid=([0-9]+) invokername=([^ ]+).*"),
-		boost::bind(&CServer::OnClientServerText, this, _1));
-
-	CNetwork::Get()->RegisterEvent(
-		boost::regex("notifytextmessage targetmode=1 msg=([^ ]+) target=([0-9]+) invokerid=([0-9]+) invokername=([^ ]+).*"),
-		boost::bind(&CServer::OnClientPrivateText, this, _1));
-	
-
+	CNetwork::Get()->RegisterNotify("notifytextmessage",
+		boost::bind(&CServer::OnTextMessage, this, _1));
+}
 
+void CServer::Synchronize(bool resync)
+{
 	//register for all events
 	CNetwork::Get()->Execute("servernotifyregister event=server");
 	CNetwork::Get()->Execute("servernotifyregister event=channel id=0");
@@ -92,11 +69,67 @@ void CServer::Initialize()
 
 
 
-	//fill up cache
-	CNetwork::Get()->Execute("channellist -flags -limit -voice",
-		boost::bind(&CServer::OnChannelList, this, _1));
-	CNetwork::Get()->Execute("clientlist -uid -ip",
-		boost::bind(&CServer::OnClientList, this, _1));
+	//fill up cache, the clients need their channels to be there
+	//the rows are collected as they arrive, the cache is only locked to merge them at the end
+	//the lists of an earlier synchronization (sent again after a reconnect) are ignored
+	const unsigned int round = ++m_SyncRound;
+	m_SyncChannels.clear();
+	m_SyncDefaultChannel = Channel::Invalid;
+	m_SyncClients.clear();
+	m_SyncNicknames.clear();
+
+	//a list which failed leaves its part of the cache as it is, the
+	//synchronization still goes on so the other part is filled
+	auto request_clients = [this, resync, round]()
+	{
+		CNetwork::Get()->ExecuteStreamed("clientlist -uid -ip",
+			[this, resync, round](boost::string_ref row)
+			{
+				if (round == m_SyncRound)
+					OnClientListRow(row, resync);
+			},
+			[this, resync, round](CNetwork::ResultSet_t &result)
+			{
+				if (round == m_SyncRound)
+					OnClientList(resync);
+			}, ECommandPriority::BACKGROUND, 0,
+			[this, round](EErrorType type, unsigned int error_id)
+			{
+				if (round != m_SyncRound)
+					return;
+
+				m_SyncClients.clear();
+				m_SyncNicknames.clear();
+				if (m_IsLoggedIn == false)
+				{
+					m_IsLoggedIn = true;
+					CCallbackHandler::Get()->Call("TSC_OnConnect");
+				}
+			});
+	};
+	CNetwork::Get()->ExecuteStreamed("channellist -flags -limit -voice",
+		[this, round](boost::string_ref row)
+		{
+			if (round == m_SyncRound)
+				OnChannelListRow(row);
+		},
+		[this, resync, round, request_clients](CNetwork::ResultSet_t &result)
+		{
+			if (round != m_SyncRound)
+				return;
+
+			OnChannelList(resync);
+			request_clients();
+		}, ECommandPriority::BACKGROUND, 0,
+		[this, round, request_clients](EErrorType type, unsigned int error_id)
+		{
+			if (round != m_SyncRound)
+				return;
+
+			m_SyncChannels.clear();
+			m_SyncDefaultChannel = Channel::Invalid;
+			request_clients();
+		});
 
 
 
@@ -106,88 +139,398 @@ void CServer::Initialize()
 		[this](CNetwork::ResultSet_t &result)
 		{
 			if (result.empty() == false)
-				CUtils::Get()->ParseField(result.at(0), "server_id", m_ServerId);
+				CSchemaRow<ServerIdResponse>(result.at(0)).Get(ServerIdResponse::server_id, m_ServerId);
 		});
 }
 
 
 
-bool CServer::Login(string login, string pass)
+void CServer::MarkCacheChanged()
 {
-	CUtils::Get()->EscapeString(login);
-	CUtils::Get()->EscapeString(pass);
-	
-	CNetwork::Get()->Execute(
-		fmt::format("login client_login_name={} client_login_password={}", login, pass),
-		boost::bind(&CServer::OnLogin, this, _1));
+	m_CacheVersion = CCallbackHandler::Get()->IncreaseCacheVersion();
+
+	if (m_IsPublishPending)
+		return;
+
+	m_IsPublishPending = true;
+
+	//handlers already queued (e.g. the rest of a read) run first; a notify flood
+	//spread over many reads is published every PublishInterval, not once per read
+	std::weak_ptr<const bool> lifetime(m_Lifetime);
+	std::function<void()> publish = [this, lifetime]()
+	{
+		if (lifetime.expired() == false && m_IsPublishPending)
+			PublishSnapshot();
+	};
+
+	const boost::chrono::steady_clock::time_point next_publish =
+		m_LastPublish + boost::chrono::milliseconds(PublishInterval);
+	const boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+	if (now >= next_publish)
+	{
+		CNetwork::Get()->Post(std::move(publish));
+	}
+	else
+	{
+		const auto delay = boost::chrono::ceil<boost::chrono::milliseconds>(next_publish - now);
+		CNetwork::Get()->Post(std::move(publish), static_cast<unsigned int>(delay.count()));
+	}
+}
+
+void CServer::PublishSnapshot()
+{
+	m_IsPublishPending = false;
+	m_LastPublish = boost::chrono::steady_clock::now();
+
+	shared_ptr<CacheSnapshot> snapshot = CopySnapshot();
+	snapshot->Version = m_CacheVersion;
+
+	//the previous snapshot is freed by whoever releases it last
+	CacheSnapshot_t published(std::move(snapshot));
+	std::atomic_store(&m_Snapshot, published);
+	CCallbackHandler::Get()->SetPublishedCacheVersion(m_CacheVersion);
+
+	if (m_IsLoggedIn)
+		CCacheFile::Get()->OnSnapshotPublished(published);
+}
+
+shared_ptr<CacheSnapshot> CServer::CopySnapshot()
+{
+	//the tables are a few flat arrays, their strings are shared
+	shared_ptr<CacheSnapshot> snapshot = std::make_shared<CacheSnapshot>();
+	{
+		boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
+		snapshot->Channels = m_Channels;
+		snapshot->ChannelNameIndex = m_ChannelNameIndex.Share();
+		snapshot->ChannelChildren = m_ChannelChildren.Share();
+		snapshot->DefaultChannel = m_DefaultChannel;
+	}
+	{
+		boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
+		snapshot->Clients = m_Clients;
+		snapshot->ClientUidIndex = m_ClientUidIndex.Share();
+		snapshot->ClientIpIndex = m_ClientIpIndex.Share();
+		snapshot->ChannelClients = m_ChannelClients.Share();
+	}
+	return snapshot;
+}
+
+bool CServer::LoadCacheFile(const string &host, unsigned short port)
+{
+	CCacheFile::Content content;
+	if (CCacheFile::Get()->Open(host, port, content) == false)
+		return false;
+
+	{
+		boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
+		boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
+		//only a fresh instance is filled, never a cache the server already sent
+		if (m_IsWarmStart || m_Channels.GetCount() != 0 || m_Clients.GetCount() != 0)
+			return false;
+
+		for (auto &c : content.Channels)
+			AddChannel(c.first, c.second);
+		RebuildChannelTree();
+		m_DefaultChannel = content.DefaultChannel;
+
+		for (auto &c : content.Clients)
+			AddClient(c.first, c.second);
+
+		//read by the network thread once it's logged in, queuing the login synchronizes
+		m_IsWarmStart = true;
+	}
+
+	//PublishSnapshot belongs to the network thread, which doesn't publish
+	//anything before it's logged in; the snapshot is stored right away instead
+	std::atomic_store(&m_Snapshot, CacheSnapshot_t(CopySnapshot()));
 	return true;
 }
 
-bool CServer::ChangeNickname(string nickname)
+
+
+//removes the entry of "id" from a secondary index
+template<typename Id_t>
+static void EraseFromIndex(unordered_multimap<string, Id_t> &index, const string &key, Id_t id)
 {
-	if (m_IsLoggedIn == false)
+	auto range = index.equal_range(key);
+	for (auto i = range.first; i != range.second; ++i)
+	{
+		if (i->second == id)
+		{
+			index.erase(i);
+			return;
+		}
+	}
+}
+
+bool CServer::AddChannel(Channel::Id_t cid, const Channel &channel)
+{
+	if (m_Channels.Insert(cid, channel) == false)
+		return false;
+
+	m_ChannelNameIndex.Edit().emplace(channel.Name, cid);
+	return true;
+}
+
+bool CServer::RemoveChannel(Channel::Id_t cid)
+{
+	const ChannelTable::Slot_t slot = m_Channels.Find(cid);
+	if (slot == ChannelTable::NoSlot)
 		return false;
 
+	UnlinkChannel(cid);
+	EraseFromIndex(m_ChannelNameIndex.Edit(), m_Channels.GetName(slot), cid);
+	m_Channels.Erase(cid);
+	return true;
+}
 
-	CUtils::Get()->EscapeString(nickname);
-	CNetwork::Get()->Execute(fmt::format("clientupdate client_nickname={}", nickname));
+bool CServer::RenameChannel(Channel::Id_t cid, const string &name)
+{
+	const ChannelTable::Slot_t slot = m_Channels.Find(cid);
+	if (slot == ChannelTable::NoSlot)
+		return false;
+
+	EraseFromIndex(m_ChannelNameIndex.Edit(), m_Channels.GetName(slot), cid);
+	m_Channels.SetName(slot, name);
+	m_ChannelNameIndex.Edit().emplace(name, cid);
 	return true;
 }
 
-bool CServer::SendServerMessage(string msg)
+void CServer::LinkChannel(Channel::Id_t cid)
 {
-	if (m_IsLoggedIn == false)
+	const ChannelTable::Slot_t slot = m_Channels.Find(cid);
+	vector<Channel::Id_t> &siblings = m_ChannelChildren.Edit()[m_Channels.ParentId[slot]];
+	const Channel::Id_t ocid = m_Channels.OrderId[slot];
+
+	auto pos = siblings.begin();
+	if (ocid != 0)
+	{
+		auto above = std::find(siblings.begin(), siblings.end(), ocid);
+		pos = above != siblings.end() ? above + 1 : siblings.end();
+	}
+
+	//the channel that was below the insert position is below this one now
+	if (pos != siblings.end())
+		m_Channels.OrderId[m_Channels.Find(*pos)] = cid;
+	siblings.insert(pos, cid);
+}
+
+void CServer::UnlinkChannel(Channel::Id_t cid)
+{
+	ChannelChildren_t &children = m_ChannelChildren.Edit();
+	auto siblings_it = children.find(m_Channels.ParentId[m_Channels.Find(cid)]);
+	if (siblings_it == children.end())
+		return;
+
+	vector<Channel::Id_t> &siblings = siblings_it->second;
+	auto pos = std::find(siblings.begin(), siblings.end(), cid);
+	if (pos == siblings.end())
+		return;
+
+	const Channel::Id_t above = pos != siblings.begin() ? *(pos - 1) : 0;
+	pos = siblings.erase(pos);
+	if (pos != siblings.end())
+		m_Channels.OrderId[m_Channels.Find(*pos)] = above;
+
+	if (siblings.empty())
+		children.erase(siblings_it);
+}
+
+bool CServer::MoveChannel(Channel::Id_t cid, Channel::Id_t pcid, Channel::Id_t ocid)
+{
+	const ChannelTable::Slot_t slot = m_Channels.Find(cid);
+	if (slot == ChannelTable::NoSlot)
 		return false;
 
-	if (msg.empty())
+	if (m_Channels.ParentId[slot] == pcid && m_Channels.OrderId[slot] == ocid)
 		return false;
 
-	if (m_ServerId == 0)
+	UnlinkChannel(cid);
+	m_Channels.ParentId[slot] = pcid;
+	m_Channels.OrderId[slot] = ocid;
+	LinkChannel(cid);
+	return true;
+}
+
+void CServer::RebuildChannelTree()
+{
+	//parent id -> (id of the channel above -> channel id)
+	unordered_map<Channel::Id_t, unordered_multimap<Channel::Id_t, Channel::Id_t>> chains;
+	m_Channels.ForEach([&](Channel::Id_t cid, ChannelTable::Slot_t slot)
+	{
+		chains[m_Channels.ParentId[slot]].emplace(m_Channels.OrderId[slot], cid);
+	});
+
+	ChannelChildren_t &children = m_ChannelChildren.Edit();
+	children.clear();
+	for (auto &p : chains)
+	{
+		unordered_multimap<Channel::Id_t, Channel::Id_t> &chain = p.second;
+		vector<Channel::Id_t> &siblings = children[p.first];
+		siblings.reserve(chain.size());
+
+		Channel::Id_t above = 0;
+		for (auto i = chain.find(above); i != chain.end(); i = chain.find(above))
+		{
+			above = i->second;
+			siblings.push_back(above);
+			chain.erase(i);
+		}
+
+		//channels of a broken chain are still listed, just at the end
+		for (auto &c : chain)
+			siblings.push_back(c.second);
+	}
+}
+
+bool CServer::AddClient(Client::Id_t clid, const Client &client)
+{
+	if (m_Clients.Insert(clid, client) == false)
 		return false;
 
+	m_ClientUidIndex.Edit().emplace(client.Uid, clid);
+	if (client.IpAddress.empty() == false)
+		m_ClientIpIndex.Edit().emplace(client.IpAddress, clid);
+	m_ChannelClients.Edit()[client.CurrentChannel].push_back(clid);
+	return true;
+}
 
-	CUtils::Get()->EscapeString(msg);
-	CNetwork::Get()->Execute(
-		fmt::format("sendtextmessage targetmode=3 target={} msg={}", m_ServerId, msg));
+bool CServer::RemoveClient(Client::Id_t clid)
+{
+	const ClientTable::Slot_t slot = m_Clients.Find(clid);
+	if (slot == ClientTable::NoSlot)
+		return false;
+
+	EraseFromIndex(m_ClientUidIndex.Edit(), m_Clients.GetUid(slot), clid);
+	EraseFromIndex(m_ClientIpIndex.Edit(), m_Clients.GetIpAddress(slot), clid);
+	RemoveChannelClient(m_Clients.CurrentChannel[slot], clid);
+	m_Clients.Erase(clid);
 	return true;
 }
 
+bool CServer::SetClientIpAddress(Client::Id_t clid, const string &ip)
+{
+	const ClientTable::Slot_t slot = m_Clients.Find(clid);
+	if (slot == ClientTable::NoSlot)
+		return false;
 
+	if (m_Clients.GetIpAddress(slot) == ip)
+		return true;
 
+	EraseFromIndex(m_ClientIpIndex.Edit(), m_Clients.GetIpAddress(slot), clid);
+	m_Clients.SetIpAddress(slot, ip);
+	if (ip.empty() == false)
+		m_ClientIpIndex.Edit().emplace(ip, clid);
+	return true;
+}
 
-bool CServer::QueryChannelData(Channel::Id_t cid, Channel::QueryData data, Callback_t callback)
+bool CServer::SetClientChannel(Client::Id_t clid, Channel::Id_t cid)
 {
-	if (IsValidChannel(cid) == false)
+	const ClientTable::Slot_t slot = m_Clients.Find(clid);
+	if (slot == ClientTable::NoSlot)
 		return false;
+
+	Channel::Id_t &current_channel = m_Clients.CurrentChannel[slot];
+	if (current_channel == cid)
+		return true;
+
+	RemoveChannelClient(current_channel, clid);
+	current_channel = cid;
+	m_ChannelClients.Edit()[cid].push_back(clid);
+	return true;
+}
+
+void CServer::RemoveChannelClient(Channel::Id_t cid, Client::Id_t clid)
+{
+	ChannelClients_t &channel_clients = m_ChannelClients.Edit();
+	auto it = channel_clients.find(cid);
+	if (it == channel_clients.end())
+		return;
+
+	//the order doesn't matter, so the last client takes the free place
+	vector<Client::Id_t> &clients = it->second;
+	auto pos = std::find(clients.begin(), clients.end(), clid);
+	if (pos == clients.end())
+		return;
+
+	*pos = clients.back();
+	clients.pop_back();
+	if (clients.empty())
+		channel_clients.erase(it);
+}
+
+
+bool CServer::Login(string login, string pass)
+{
+	CNetwork::Get()->Login(login, pass,
+		boost::bind(&CServer::OnLogin, this, _1));
+	return true;
+}
+
+CServer::CommandId_t CServer::ChangeNickname(string nickname)
+{
+	if (m_IsLoggedIn == false)
+		return 0;
+
+
+	return CNetwork::Get()->Execute(fmt::format("clientupdate client_nickname={}", Escaped(nickname)));
+}
+
+CServer::CommandId_t CServer::SendServerMessage(string msg)
+{
+	if (m_IsLoggedIn == false)
+		return 0;
+
+	if (msg.empty())
+		return 0;
+
+	if (m_ServerId == 0)
+		return 0;
+
+
+	return CNetwork::Get()->Execute(
+		fmt::format("sendtextmessage targetmode=3 target={} msg={}", m_ServerId, Escaped(msg)),
+		CNetwork::ReadCallback_t(), ECommandPriority::INTERACTIVE);
+}
+
+
+
+
+CServer::CommandId_t CServer::QueryChannelData(Channel::Id_t cid, Channel::QueryData data, Callback_t callback)
+{
+	if (IsValidChannel(cid) == false)
+		return 0;
 	
 	if (data == Channel::QueryData::INVALID || callback == nullptr)
-		return false;
+		return 0;
 
 	
-	static const unordered_map<Channel::QueryData, string> data_map{
-		{Channel::QueryData::CHANNEL_TOPIC,					"channel_topic" },
-		{Channel::QueryData::CHANNEL_DESCRIPTION,			"channel_description" },
-		{Channel::QueryData::CHANNEL_CODEC,					"channel_codec" },
-		{Channel::QueryData::CHANNEL_CODEC_QUALITY,			"channel_codec_quality" },
-		{Channel::QueryData::CHANNEL_FORCED_SILENCE,		"channel_forced_silence" },
-		{Channel::QueryData::CHANNEL_ICON_ID,				"channel_icon_id" },
-		{Channel::QueryData::CHANNEL_CODEC_IS_UNENCRYPTED,	"channel_codec_is_unencrypted" },
-		{Channel::QueryData::CHANNEL_SECONDS_EMPTY,			"seconds_empty" }
+	//indexed by Channel::QueryData, without INVALID
+	static const ChannelInfoResponse::Field data_fields[] = {
+		ChannelInfoResponse::channel_topic,					//CHANNEL_TOPIC
+		ChannelInfoResponse::channel_description,			//CHANNEL_DESCRIPTION
+		ChannelInfoResponse::channel_codec,					//CHANNEL_CODEC
+		ChannelInfoResponse::channel_codec_quality,			//CHANNEL_CODEC_QUALITY
+		ChannelInfoResponse::channel_forced_silence,		//CHANNEL_FORCED_SILENCE
+		ChannelInfoResponse::channel_icon_id,				//CHANNEL_ICON_ID
+		ChannelInfoResponse::channel_codec_is_unencrypted,	//CHANNEL_CODEC_IS_UNENCRYPTED
+		ChannelInfoResponse::seconds_empty					//CHANNEL_SECONDS_EMPTY
 	};
+	static const size_t num_data_fields = sizeof(data_fields) / sizeof(data_fields[0]);
+	static_assert(num_data_fields == static_cast<size_t>(Channel::QueryData::CHANNEL_SECONDS_EMPTY),
+		"every Channel::QueryData needs a field");
 
-	auto it = data_map.find(data);
-	if (it == data_map.end())
-		return false;
+	const size_t data_idx = static_cast<size_t>(data) - 1;
+	if (data_idx >= num_data_fields)
+		return 0;
+	const ChannelInfoResponse::Field data_field = data_fields[data_idx];
 
 
-	CNetwork::Get()->Execute(fmt::format("channelinfo cid={}", cid),
+	return CNetwork::Get()->Execute(fmt::format("channelinfo cid={}", cid),
 		[=](CNetwork::ResultSet_t &result)
 	{
-		string
-			&info = result.at(0),
-			data_dest;
-
-		CUtils::Get()->ParseField(info, it->second, data_dest);
+		string data_dest;
+		CSchemaRow<ChannelInfoResponse>(result.at(0)).Get(data_field, data_dest);
 		CUtils::Get()->UnEscapeString(data_dest);
 		m_QueriedData.push(data_dest);
 
@@ -201,60 +544,61 @@ bool CServer::QueryChannelData(Channel::Id_t cid, Channel::QueryData data, Callb
 		});
 		CCallbackHandler::Get()->Call(callback);
 	});
-	return true;
 }
 
-bool CServer::QueryClientData(Client::Id_t clid, Client::QueryData data, Callback_t callback)
+CServer::CommandId_t CServer::QueryClientData(Client::Id_t clid, Client::QueryData data, Callback_t callback)
 {
 	if (IsValidClient(clid) == false)
-		return false;
+		return 0;
 
 	if (data == Client::QueryData::INVALID || callback == nullptr)
-		return false;
+		return 0;
 
 
-	static const unordered_map<Client::QueryData, string> data_map{
-		{ Client::QueryData::CLIENT_NICKNAME,				"client_nickname" },
-		{ Client::QueryData::CLIENT_VERSION,				"client_version" },
-		{ Client::QueryData::CLIENT_PLATFORM,				"client_platform" },
-		{ Client::QueryData::CLIENT_INPUT_MUTED,			"client_input_muted" },
-		{ Client::QueryData::CLIENT_OUTPUT_MUTED,			"client_output_muted" },
-		{ Client::QueryData::CLIENT_INPUT_HARDWARE,			"client_input_hardware" },
-		{ Client::QueryData::CLIENT_OUTPUT_HARDWARE,		"client_output_hardware" },
-		{ Client::QueryData::CLIENT_CHANNEL_GROUP_ID,		"client_channel_group_id" },
-		{ Client::QueryData::CLIENT_SERVER_GROUPS,			"client_servergroups" },
-		{ Client::QueryData::CLIENT_FIRSTCONNECTED,			"client_created" },
-		{ Client::QueryData::CLIENT_LASTCONNECTED,			"client_lastconnected" },
-		{ Client::QueryData::CLIENT_TOTALCONNECTIONS,		"client_totalconnections" },
-		{ Client::QueryData::CLIENT_AWAY,					"client_away" },
-		{ Client::QueryData::CLIENT_AWAY_MESSAGE,			"client_away_message" },
-		{ Client::QueryData::CLIENT_AVATAR,					"client_flag_avatar" },
-		{ Client::QueryData::CLIENT_TALK_POWER,				"client_talk_power" },
-		{ Client::QueryData::CLIENT_TALK_REQUEST,			"client_talk_request" },
-		{ Client::QueryData::CLIENT_TALK_REQUEST_MSG,		"client_talk_request_msg" },
-		{ Client::QueryData::CLIENT_IS_TALKER,				"client_is_talker" },
-		{ Client::QueryData::CLIENT_IS_PRIORITY_SPEAKER,	"client_is_priority_speaker" },
-		{ Client::QueryData::CLIENT_DESCRIPTION,			"client_description" },
-		{ Client::QueryData::CLIENT_IS_CHANNEL_COMMANDER,	"client_is_channel_commander" },
-		{ Client::QueryData::CLIENT_ICON_ID,				"client_icon_id" },
-		{ Client::QueryData::CLIENT_COUNTRY,				"client_country" },
-		{ Client::QueryData::CLIENT_IDLE_TIME,				"client_idle_time" },
-		{ Client::QueryData::CLIENT_IS_RECORDING,			"client_is_recording" }
+	//indexed by Client::QueryData, without INVALID
+	static const ClientInfoResponse::Field data_fields[] = {
+		ClientInfoResponse::client_nickname,			//CLIENT_NICKNAME
+		ClientInfoResponse::client_version,				//CLIENT_VERSION
+		ClientInfoResponse::client_platform,			//CLIENT_PLATFORM
+		ClientInfoResponse::client_input_muted,			//CLIENT_INPUT_MUTED
+		ClientInfoResponse::client_output_muted,		//CLIENT_OUTPUT_MUTED
+		ClientInfoResponse::client_input_hardware,		//CLIENT_INPUT_HARDWARE
+		ClientInfoResponse::client_output_hardware,		//CLIENT_OUTPUT_HARDWARE
+		ClientInfoResponse::client_channel_group_id,	//CLIENT_CHANNEL_GROUP_ID
+		ClientInfoResponse::client_servergroups,		//CLIENT_SERVER_GROUPS
+		ClientInfoResponse::client_created,				//CLIENT_FIRSTCONNECTED
+		ClientInfoResponse::client_lastconnected,		//CLIENT_LASTCONNECTED
+		ClientInfoResponse::client_totalconnections,	//CLIENT_TOTALCONNECTIONS
+		ClientInfoResponse::client_away,				//CLIENT_AWAY
+		ClientInfoResponse::client_away_message,		//CLIENT_AWAY_MESSAGE
+		ClientInfoResponse::client_flag_avatar,			//CLIENT_AVATAR
+		ClientInfoResponse::client_talk_power,			//CLIENT_TALK_POWER
+		ClientInfoResponse::client_talk_request,		//CLIENT_TALK_REQUEST
+		ClientInfoResponse::client_talk_request_msg,	//CLIENT_TALK_REQUEST_MSG
+		ClientInfoResponse::client_is_talker,			//CLIENT_IS_TALKER
+		ClientInfoResponse::client_is_priority_speaker,	//CLIENT_IS_PRIORITY_SPEAKER
+		ClientInfoResponse::client_description,			//CLIENT_DESCRIPTION
+		ClientInfoResponse::client_is_channel_commander,	//CLIENT_IS_CHANNEL_COMMANDER
+		ClientInfoResponse::client_icon_id,				//CLIENT_ICON_ID
+		ClientInfoResponse::client_country,				//CLIENT_COUNTRY
+		ClientInfoResponse::client_idle_time,			//CLIENT_IDLE_TIME
+		ClientInfoResponse::client_is_recording			//CLIENT_IS_RECORDING
 	};
+	static const size_t num_data_fields = sizeof(data_fields) / sizeof(data_fields[0]);
+	static_assert(num_data_fields == static_cast<size_t>(Client::QueryData::CLIENT_IS_RECORDING),
+		"every Client::QueryData needs a field");
 
-	auto it = data_map.find(data);
-	if (it == data_map.end())
-		return false;
+	const size_t data_idx = static_cast<size_t>(data) - 1;
+	if (data_idx >= num_data_fields)
+		return 0;
+	const ClientInfoResponse::Field data_field = data_fields[data_idx];
 
 
-	CNetwork::Get()->Execute(fmt::format("clientinfo clid={}", clid),
+	return CNetwork::Get()->Execute(fmt::format("clientinfo clid={}", clid),
 		[=](CNetwork::ResultSet_t &result)
 	{
-		string
-			&info = result.at(0),
-			data_dest;
-
-		CUtils::Get()->ParseField(info, it->second, data_dest);
+		string data_dest;
+		CSchemaRow<ClientInfoResponse>(result.at(0)).Get(data_field, data_dest);
 		CUtils::Get()->UnEscapeString(data_dest);
 		m_QueriedData.push(data_dest);
 
@@ -268,7 +612,6 @@ bool CServer::QueryClientData(Client::Id_t clid, Client::QueryData data, Callbac
 		});
 		CCallbackHandler::Get()->Call(callback);
 	});
-	return true;
 }
 
 bool CServer::GetQueriedData(string &dest)
@@ -285,26 +628,26 @@ bool CServer::GetQueriedData(int &dest)
 
 
 
-bool CServer::CreateChannel(string name, Channel::Types type, int maxusers, 
+CServer::CommandId_t CServer::CreateChannel(string name, Channel::Types type, int maxusers, 
 	Channel::Id_t pcid, Channel::Id_t ocid, int talkpower)
 {
 	if (m_IsLoggedIn == false)
-		return false;
+		return 0;
 
 	if (name.empty())
-		return false;
+		return 0;
 
 	if (type == Channel::Types::INVALID)
-		return false;
+		return 0;
 
 	if (maxusers < -1)
-		return false;
+		return 0;
 
 	if (pcid != 0 && pcid != Channel::Invalid && IsValidChannel(pcid) == false)
-		return false;
+		return 0;
 
 	if (ocid != 0 && ocid != Channel::Invalid && IsValidChannel(ocid) == false)
-		return false;
+		return 0;
 
 
 	string type_flag_str;
@@ -323,13 +666,10 @@ bool CServer::CreateChannel(string name, Channel::Types type, int maxusers,
 		break;
 
 	default:
-		return false;
+		return 0;
 	}
 
-	CUtils::Get()->EscapeString(name);
-	
-
-	string cmd = fmt::format("channelcreate channel_name={} {}=1", name, type_flag_str);
+	string cmd = fmt::format("channelcreate channel_name={} {}=1", Escaped(name), type_flag_str);
 
 	if (maxusers != -1)
 		cmd.append(fmt::format(" channel_maxclients={} channel_flag_maxclients_unlimited=0", maxusers));
@@ -343,93 +683,92 @@ bool CServer::CreateChannel(string name, Channel::Types type, int maxusers,
 	if (ocid != Channel::Invalid)
 		cmd.append(fmt::format(" channel_order={}", ocid));
 
-	CNetwork::Get()->Execute(cmd);
-	return true;
+	return CNetwork::Get()->Execute(cmd);
 }
 
-bool CServer::DeleteChannel(Channel::Id_t cid)
+CServer::CommandId_t CServer::DeleteChannel(Channel::Id_t cid)
 {
 	if (m_IsLoggedIn == false)
-		return false;
+		return 0;
 
 	if (IsValidChannel(cid) == false)
-		return false;
+		return 0;
 
 
-	CNetwork::Get()->Execute(fmt::format("channeldelete cid={} force=1", cid),
-		[this, cid](CNetwork::ResultSet_t &result)
+	const auto generation = GetSnapshot()->Channels.GetGeneration(cid);
+	return CNetwork::Get()->Execute(fmt::format("channeldelete cid={} force=1", cid),
+		[this, cid, generation](CNetwork::ResultSet_t &result)
 		{
 			boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-			m_Channels.erase(cid);
+			if (m_Channels.Find(cid, generation) == ChannelTable::NoSlot)
+				return;
+			MarkCacheChanged();
+			RemoveChannel(cid);
 		});
-	return true;
 }
 
-bool CServer::SetChannelName(Channel::Id_t cid, string name)
+CServer::CommandId_t CServer::SetChannelName(Channel::Id_t cid, string name)
 {
 	if (m_IsLoggedIn == false)
-		return false;
+		return 0;
 
 	if (IsValidChannel(cid) == false)
-		return false;
+		return 0;
 
 	if (name.empty())
-		return false;
+		return 0;
 	
 
-	string unescaped_name(name);
-
-	CUtils::Get()->EscapeString(name);
-	CNetwork::Get()->Execute(fmt::format("channeledit cid={} channel_name={}", cid, name),
-		[this, cid, unescaped_name](CNetwork::ResultSet_t &result)
+	const auto generation = GetSnapshot()->Channels.GetGeneration(cid);
+	return CNetwork::Get()->Execute(fmt::format("channeledit cid={} channel_name={}", cid, Escaped(name)),
+		[this, cid, generation, name](CNetwork::ResultSet_t &result)
 		{
 			boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-			m_Channels.at(cid)->Name = unescaped_name;
+			if (m_Channels.Find(cid, generation) == ChannelTable::NoSlot)
+				return;
+			MarkCacheChanged();
+			RenameChannel(cid, name);
 		});
-	return true;
 }
 
 string CServer::GetChannelName(Channel::Id_t cid)
 {
-	if (IsValidChannel(cid))
-	{
-		boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-		return m_Channels.at(cid)->Name;
-	}
-	else
-		return string();
+	CacheSnapshot_t snapshot = GetSnapshot();
+	const ChannelTable::Slot_t slot = snapshot->Channels.Find(cid);
+	return slot != ChannelTable::NoSlot ? snapshot->Channels.GetName(slot) : string();
 }
 
-bool CServer::SetChannelDescription(Channel::Id_t cid, string desc)
+CServer::CommandId_t CServer::SetChannelDescription(Channel::Id_t cid, string desc)
 {
 	if (m_IsLoggedIn == false)
-		return false;
+		return 0;
 
 	if (IsValidChannel(cid) == false)
-		return false;
+		return 0;
 
 
-	CUtils::Get()->EscapeString(desc);
-	CNetwork::Get()->Execute(fmt::format("channeledit cid={} channel_description={}", cid, desc));
-	return true;
+	return CNetwork::Get()->Execute(fmt::format("channeledit cid={} channel_description={}", cid, Escaped(desc)));
 }
 
-bool CServer::SetChannelType(Channel::Id_t cid, Channel::Types type)
+CServer::CommandId_t CServer::SetChannelType(Channel::Id_t cid, Channel::Types type)
 {
 	if (m_IsLoggedIn == false)
-		return false;
+		return 0;
 
 	if (IsValidChannel(cid) == false)
-		return false;
+		return 0;
 
 
 	string
 		type_flag_str,
 		old_type_flag_str;
 
-	m_ChannelMtx.lock();
-	auto current_type = m_Channels.at(cid)->Type;
-	m_ChannelMtx.unlock();
+	//the channel might be deleted and its id reused until the edit is done
+	CacheSnapshot_t snapshot = GetSnapshot();
+	const ChannelTable::Slot_t slot = snapshot->Channels.Find(cid);
+	const auto current_type = slot != ChannelTable::NoSlot
+		? snapshot->Channels.Type[slot] : Channel::Types::INVALID;
+	const auto generation = snapshot->Channels.GetGeneration(cid);
 
 	switch(type) 
 	{
@@ -446,7 +785,7 @@ bool CServer::SetChannelType(Channel::Id_t cid, Channel::Types type)
 		break;
 
 		default:
-			return false;
+			return 0;
 	}
 
 	switch (current_type)
@@ -464,225 +803,303 @@ bool CServer::SetChannelType(Channel::Id_t cid, Channel::Types type)
 			break;
 
 		default:
-			return false;
+			return 0;
 	}
 
-	CNetwork::Get()->Execute(fmt::format("channeledit cid={} {}=1 {}=0", cid, type_flag_str, old_type_flag_str),
-		[this, cid, type](CNetwork::ResultSet_t &result)
+	return CNetwork::Get()->Execute(fmt::format("channeledit cid={} {}=1 {}=0", cid, type_flag_str, old_type_flag_str),
+		[this, cid, generation, type](CNetwork::ResultSet_t &result)
 		{
 			boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-			m_Channels.at(cid)->Type = type;
+			const ChannelTable::Slot_t slot = m_Channels.Find(cid, generation);
+			if (slot == ChannelTable::NoSlot)
+				return;
+			MarkCacheChanged();
+			m_Channels.Type[slot] = type;
 		});
-	return true;
 }
 
 Channel::Types CServer:: GetChannelType(Channel::Id_t cid)
 {
-	if (IsValidChannel(cid))
-	{
-		boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-		return m_Channels.at(cid)->Type;
-	}
-	else
-		return Channel::Types::INVALID;
+	CacheSnapshot_t snapshot = GetSnapshot();
+	const ChannelTable::Slot_t slot = snapshot->Channels.Find(cid);
+	return slot != ChannelTable::NoSlot ? snapshot->Channels.Type[slot] : Channel::Types::INVALID;
 }
 
-bool CServer::SetChannelPassword(Channel::Id_t cid, string password)
+CServer::CommandId_t CServer::SetChannelPassword(Channel::Id_t cid, string password)
 {
 	if (m_IsLoggedIn == false)
-		return false;
+		return 0;
 
 	if (IsValidChannel(cid) == false)
-		return false;
+		return 0;
 
 
 	bool password_empty = password.empty();
-	CUtils::Get()->EscapeString(password);
-	CNetwork::Get()->Execute(fmt::format("channeledit cid={} channel_password={}", cid, password),
-		[this, cid, password_empty](CNetwork::ResultSet_t &result)
+	const auto generation = GetSnapshot()->Channels.GetGeneration(cid);
+	return CNetwork::Get()->Execute(fmt::format("channeledit cid={} channel_password={}", cid, Escaped(password)),
+		[this, cid, generation, password_empty](CNetwork::ResultSet_t &result)
 		{
 			boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-			m_Channels.at(cid)->HasPassword = (password_empty == false);
+			const ChannelTable::Slot_t slot = m_Channels.Find(cid, generation);
+			if (slot == ChannelTable::NoSlot)
+				return;
+			MarkCacheChanged();
+			m_Channels.SetFlag(slot, ChannelTable::HAS_PASSWORD, password_empty == false);
 		});
-	return true;
 }
 
 bool CServer::HasChannelPassword(Channel::Id_t cid)
 {
-	if (IsValidChannel(cid))
-	{
-		boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-		return m_Channels.at(cid)->HasPassword;
-	}
-	else
-		return false;
+	CacheSnapshot_t snapshot = GetSnapshot();
+	const ChannelTable::Slot_t slot = snapshot->Channels.Find(cid);
+	return slot != ChannelTable::NoSlot && snapshot->Channels.HasFlag(slot, ChannelTable::HAS_PASSWORD);
 }
 
-bool CServer::SetChannelRequiredTalkPower(Channel::Id_t cid, int talkpower)
+CServer::CommandId_t CServer::SetChannelRequiredTalkPower(Channel::Id_t cid, int talkpower)
 {
 	if (m_IsLoggedIn == false)
-		return false;
+		return 0;
 
 	if (IsValidChannel(cid) == false)
-		return false;
+		return 0;
 
 
-	CNetwork::Get()->Execute(fmt::format("channeledit cid={} channel_needed_talk_power={}", cid, talkpower),
-		[this, cid, talkpower](CNetwork::ResultSet_t &result)
+	const auto generation = GetSnapshot()->Channels.GetGeneration(cid);
+	return CNetwork::Get()->Execute(fmt::format("channeledit cid={} channel_needed_talk_power={}", cid, talkpower),
+		[this, cid, generation, talkpower](CNetwork::ResultSet_t &result)
 		{
 			boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-			m_Channels.at(cid)->RequiredTalkPower = talkpower;
+			const ChannelTable::Slot_t slot = m_Channels.Find(cid, generation);
+			if (slot == ChannelTable::NoSlot)
+				return;
+			MarkCacheChanged();
+			m_Channels.RequiredTalkPower[slot] = talkpower;
 		});
-	return true;
 }
 
 int CServer::GetChannelRequiredTalkPower(Channel::Id_t cid)
 {
-	if (IsValidChannel(cid))
-	{
-		boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-		return m_Channels.at(cid)->RequiredTalkPower;
-	}
-	else
-		return 0;
+	CacheSnapshot_t snapshot = GetSnapshot();
+	const ChannelTable::Slot_t slot = snapshot->Channels.Find(cid);
+	return slot != ChannelTable::NoSlot ? snapshot->Channels.RequiredTalkPower[slot] : 0;
 }
 
-bool CServer::SetChannelUserLimit(Channel::Id_t cid, int maxusers)
+CServer::CommandId_t CServer::SetChannelUserLimit(Channel::Id_t cid, int maxusers)
 {
 	if (m_IsLoggedIn == false)
-		return false;
+		return 0;
 
 	if (IsValidChannel(cid) == false)
-		return false;
+		return 0;
 
 	if (maxusers < -1)
-		return false;
+		return 0;
 
 
-	CNetwork::Get()->Execute(fmt::format("channeledit cid={} channel_maxclients={} channel_flag_maxclients_unlimited={}", cid, maxusers, maxusers == -1 ? 1 : 0),
-		[this, cid, maxusers](CNetwork::ResultSet_t &result)
+	const auto generation = GetSnapshot()->Channels.GetGeneration(cid);
+	return CNetwork::Get()->Execute(fmt::format("channeledit cid={} channel_maxclients={} channel_flag_maxclients_unlimited={}", cid, maxusers, maxusers == -1 ? 1 : 0),
+		[this, cid, generation, maxusers](CNetwork::ResultSet_t &result)
 		{
 			boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-			m_Channels.at(cid)->MaxClients = maxusers;
+			const ChannelTable::Slot_t slot = m_Channels.Find(cid, generation);
+			if (slot == ChannelTable::NoSlot)
+				return;
+			MarkCacheChanged();
+			m_Channels.MaxClients[slot] = maxusers;
 		});
-	return true;
 }
 
 int CServer::GetChannelUserLimit(Channel::Id_t cid)
 {
-	if (IsValidChannel(cid))
-	{
-		boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-		return m_Channels.at(cid)->MaxClients;
-	}
-	else
-		return 0;
+	CacheSnapshot_t snapshot = GetSnapshot();
+	const ChannelTable::Slot_t slot = snapshot->Channels.Find(cid);
+	return slot != ChannelTable::NoSlot ? snapshot->Channels.MaxClients[slot] : 0;
 }
 
-bool CServer::SetChannelParentId(Channel::Id_t cid, Channel::Id_t pcid)
+CServer::CommandId_t CServer::SetChannelParentId(Channel::Id_t cid, Channel::Id_t pcid)
 {
 	if (m_IsLoggedIn == false)
-		return false;
+		return 0;
 
 	if (IsValidChannel(cid) == false)
-		return false;
+		return 0;
 
 	if (pcid != 0 && IsValidChannel(pcid) == false)
-		return false;
-
-	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
+		return 0;
 
-	if (m_Channels.at(cid)->ParentId == pcid)
-		return false;
+	if (GetChannelParentId(cid) == pcid)
+		return 0;
 
 
-	CNetwork::Get()->Execute(fmt::format("channelmove cid={} cpid={}", cid, pcid),
-		[this, cid, pcid](CNetwork::ResultSet_t &result)
+	const auto generation = GetSnapshot()->Channels.GetGeneration(cid);
+	return CNetwork::Get()->Execute(fmt::format("channelmove cid={} cpid={}", cid, pcid),
+		[this, cid, generation, pcid](CNetwork::ResultSet_t &result)
 		{
 			boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-			m_Channels.at(cid)->ParentId = pcid;
+			const ChannelTable::Slot_t slot = m_Channels.Find(cid, generation);
+			if (slot == ChannelTable::NoSlot)
+				return;
+			MarkCacheChanged();
+			MoveChannel(cid, pcid, m_Channels.OrderId[slot]);
 		});
-	return true;
 }
 
 Channel::Id_t CServer::GetChannelParentId(Channel::Id_t cid)
 {
-	if (IsValidChannel(cid))
-	{
-		boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-		return m_Channels.at(cid)->ParentId;
-	}
-	else
-		return Channel::Invalid;
+	CacheSnapshot_t snapshot = GetSnapshot();
+	const ChannelTable::Slot_t slot = snapshot->Channels.Find(cid);
+	return slot != ChannelTable::NoSlot ? snapshot->Channels.ParentId[slot] : Channel::Id_t(Channel::Invalid);
 }
 
-bool CServer::SetChannelOrderId(Channel::Id_t cid, Channel::Id_t ocid)
+CServer::CommandId_t CServer::SetChannelOrderId(Channel::Id_t cid, Channel::Id_t ocid)
 {
 	if (m_IsLoggedIn == false)
-		return false;
+		return 0;
 
 	if (IsValidChannel(cid) == false)
-		return false;
+		return 0;
 
 	if (ocid != 0 && IsValidChannel(ocid) == false)
-		return false;
-
-	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
+		return 0;
 
-	if (m_Channels.at(cid)->OrderId == ocid)
-		return false;
+	if (GetChannelOrderId(cid) == ocid)
+		return 0;
 
 
-	CNetwork::Get()->Execute(fmt::format("channeledit cid={} channel_order={}", cid, ocid),
-		[this, cid, ocid](CNetwork::ResultSet_t &result)
+	const auto generation = GetSnapshot()->Channels.GetGeneration(cid);
+	return CNetwork::Get()->Execute(fmt::format("channeledit cid={} channel_order={}", cid, ocid),
+		[this, cid, generation, ocid](CNetwork::ResultSet_t &result)
 		{
 			boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-			m_Channels.at(cid)->OrderId = ocid;
+			const ChannelTable::Slot_t slot = m_Channels.Find(cid, generation);
+			if (slot == ChannelTable::NoSlot)
+				return;
+			MarkCacheChanged();
+			MoveChannel(cid, m_Channels.ParentId[slot], ocid);
 		});
-	return true;
 }
 
 Channel::Id_t CServer::GetChannelOrderId(Channel::Id_t cid)
 {
-	if (IsValidChannel(cid))
+	CacheSnapshot_t snapshot = GetSnapshot();
+	const ChannelTable::Slot_t slot = snapshot->Channels.Find(cid);
+	return slot != ChannelTable::NoSlot ? snapshot->Channels.OrderId[slot] : Channel::Id_t(Channel::Invalid);
+}
+
+unsigned int CServer::GetChannelChildCount(Channel::Id_t cid)
+{
+	CacheSnapshot_t snapshot = GetSnapshot();
+	auto it = snapshot->ChannelChildren->find(cid);
+	return it != snapshot->ChannelChildren->end() ? static_cast<unsigned int>(it->second.size()) : 0;
+}
+
+vector<Channel::Id_t> CServer::GetChannelChildren(Channel::Id_t cid, size_t max_count)
+{
+	vector<Channel::Id_t> children;
+
+	CacheSnapshot_t snapshot = GetSnapshot();
+	auto it = snapshot->ChannelChildren->find(cid);
+	if (it != snapshot->ChannelChildren->end())
 	{
-		boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-		return m_Channels.at(cid)->OrderId;
+		const vector<Channel::Id_t> &list = it->second;
+		children.assign(list.begin(), list.begin() + std::min(list.size(), max_count));
 	}
-	else
-		return Channel::Invalid;
+	return children;
+}
+
+vector<Channel::Id_t> CServer::GetChannelSiblings(Channel::Id_t cid, size_t max_count)
+{
+	vector<Channel::Id_t> siblings;
+
+	CacheSnapshot_t snapshot = GetSnapshot();
+	const ChannelTable::Slot_t slot = snapshot->Channels.Find(cid);
+	if (slot == ChannelTable::NoSlot)
+		return siblings;
+
+	auto it = snapshot->ChannelChildren->find(snapshot->Channels.ParentId[slot]);
+	if (it == snapshot->ChannelChildren->end())
+		return siblings;
+
+	for (Channel::Id_t sibling : it->second)
+	{
+		if (siblings.size() == max_count)
+			break;
+		if (sibling != cid)
+			siblings.push_back(sibling);
+	}
+	return siblings;
+}
+
+vector<Channel::Id_t> CServer::GetChannelSubtree(Channel::Id_t cid, size_t max_count)
+{
+	vector<Channel::Id_t> subtree;
+
+	CacheSnapshot_t snapshot = GetSnapshot();
+	auto it = snapshot->ChannelChildren->find(cid);
+	if (it == snapshot->ChannelChildren->end())
+		return subtree;
+
+	//child list and position in it, one per level
+	vector<std::pair<const vector<Channel::Id_t> *, size_t>> stack;
+	stack.emplace_back(&it->second, 0);
+	while (stack.empty() == false && subtree.size() < max_count)
+	{
+		const vector<Channel::Id_t> &children = *stack.back().first;
+		size_t &pos = stack.back().second;
+		if (pos == children.size())
+		{
+			stack.pop_back();
+			continue;
+		}
+
+		const Channel::Id_t child = children[pos++];
+		subtree.push_back(child);
+
+		auto child_it = snapshot->ChannelChildren->find(child);
+		if (child_it != snapshot->ChannelChildren->end())
+			stack.emplace_back(&child_it->second, 0);
+	}
+	return subtree;
+}
+
+unsigned int CServer::GetChannelClientCount(Channel::Id_t cid)
+{
+	CacheSnapshot_t snapshot = GetSnapshot();
+	auto it = snapshot->ChannelClients->find(cid);
+	return it != snapshot->ChannelClients->end() ? static_cast<unsigned int>(it->second.size()) : 0;
 }
 
-Channel::Id_t CServer::GetChannelIdByName(string name)
+vector<Client::Id_t> CServer::GetChannelClients(Channel::Id_t cid, size_t max_count)
 {
-	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-	if (name.empty() == false)
+	vector<Client::Id_t> clients;
+
+	CacheSnapshot_t snapshot = GetSnapshot();
+	auto it = snapshot->ChannelClients->find(cid);
+	if (it != snapshot->ChannelClients->end())
 	{
-		for (auto &i : m_Channels)
-		{
-			if (i.second->Name == name)
-				return i.first;
-		}
+		const vector<Client::Id_t> &list = it->second;
+		clients.assign(list.begin(), list.begin() + std::min(list.size(), max_count));
 	}
+	return clients;
+}
 
-	return Channel::Invalid;
+Channel::Id_t CServer::GetChannelIdByName(string name)
+{
+	CacheSnapshot_t snapshot = GetSnapshot();
+	auto it = snapshot->ChannelNameIndex->find(name);
+	return it != snapshot->ChannelNameIndex->end() ? it->second : Channel::Invalid;
 }
 
 
 
 Client::Id_t CServer::GetClientIdByUid(string uid)
 {
-	boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
-	if (uid.empty() == false)
-	{
-		for (auto &i : m_Clients)
-		{
-			if (i.second->Uid == uid)
-				return i.first;
-		}
-	}
+	if (uid.empty())
+		return Client::Invalid;
 
-	return Client::Invalid;
+	CacheSnapshot_t snapshot = GetSnapshot();
+	auto it = snapshot->ClientUidIndex->find(uid);
+	return it != snapshot->ClientUidIndex->end() ? it->second : Client::Invalid;
 }
 
 Client::Id_t CServer::GetClientIdByIpAddress(string ip)
@@ -690,67 +1107,46 @@ Client::Id_t CServer::GetClientIdByIpAddress(string ip)
 	if (ip.empty())
 		return Client::Invalid;
 
-	boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
-	for (auto &i : m_Clients)
-	{
-		if (i.second->IpAddress.compare(ip) == 0)
-			return i.first;
-	}
-
-	return Client::Invalid;
+	CacheSnapshot_t snapshot = GetSnapshot();
+	auto it = snapshot->ClientIpIndex->find(ip);
+	return it != snapshot->ClientIpIndex->end() ? it->second : Client::Invalid;
 }
 
 string CServer::GetClientUid(Client::Id_t clid)
 {
-	if (IsValidClient(clid))
-	{
-		boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
-		return m_Clients.at(clid)->Uid;
-	}
-	else
-		return string();
+	CacheSnapshot_t snapshot = GetSnapshot();
+	const ClientTable::Slot_t slot = snapshot->Clients.Find(clid);
+	return slot != ClientTable::NoSlot ? snapshot->Clients.GetUid(slot) : string();
 }
 
 Client::Id_t CServer::GetClientDatabaseId(Client::Id_t clid)
 {
-	if (IsValidClient(clid))
-	{
-		boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
-		return m_Clients.at(clid)->DatabaseId;
-	}
-	else
-		return Client::Invalid;
+	CacheSnapshot_t snapshot = GetSnapshot();
+	const ClientTable::Slot_t slot = snapshot->Clients.Find(clid);
+	return slot != ClientTable::NoSlot ? snapshot->Clients.DatabaseId[slot] : Client::Id_t(Client::Invalid);
 }
 
 Channel::Id_t CServer::GetClientChannelId(Client::Id_t clid)
 {
-	if (IsValidClient(clid))
-	{
-		boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
-		return m_Clients.at(clid)->CurrentChannel;
-	}
-	else
-		return Channel::Invalid;
+	CacheSnapshot_t snapshot = GetSnapshot();
+	const ClientTable::Slot_t slot = snapshot->Clients.Find(clid);
+	return slot != ClientTable::NoSlot ? snapshot->Clients.CurrentChannel[slot] : Channel::Id_t(Channel::Invalid);
 }
 
 string CServer::GetClientIpAddress(Client::Id_t clid)
 {
-	if (IsValidClient(clid))
-	{
-		boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
-		return m_Clients.at(clid)->IpAddress;
-	}
-	else
-		return string();
+	CacheSnapshot_t snapshot = GetSnapshot();
+	const ClientTable::Slot_t slot = snapshot->Clients.Find(clid);
+	return slot != ClientTable::NoSlot ? snapshot->Clients.GetIpAddress(slot) : string();
 }
 
-bool CServer::KickClient(Client::Id_t clid, Client::KickTypes type, string reasonmsg)
+CServer::CommandId_t CServer::KickClient(Client::Id_t clid, Client::KickTypes type, string reasonmsg)
 {
 	if (IsValidClient(clid) == false)
-		return false;
+		return 0;
 
 	if (type == Client::KickTypes::INVALID)
-		return false;
+		return 0;
 
 
 	int kicktype_id;
@@ -765,7 +1161,7 @@ bool CServer::KickClient(Client::Id_t clid, Client::KickTypes type, string reaso
 			break;
 
 		default:
-			return false;
+			return 0;
 	}
 
 
@@ -777,139 +1173,137 @@ bool CServer::KickClient(Client::Id_t clid, Client::KickTypes type, string reaso
 			reasonmsg.pop_back();
 	}
 
-	CNetwork::Get()->Execute(fmt::format("clientkick clid={} reasonid={} reasonmsg={}", clid, kicktype_id, reasonmsg));
-	return true;
+	return CNetwork::Get()->Execute(fmt::format("clientkick clid={} reasonid={} reasonmsg={}", clid, kicktype_id, reasonmsg),
+		CNetwork::ReadCallback_t(), ECommandPriority::INTERACTIVE);
 }
 
-bool CServer::BanClient(string uid, int seconds, string reasonmsg)
+CServer::CommandId_t CServer::BanClient(string uid, int seconds, string reasonmsg)
 {
 	if (uid.empty())
-		return false;
+		return 0;
 
 
-	CUtils::Get()->EscapeString(uid);
-	CUtils::Get()->EscapeString(reasonmsg);
-	CNetwork::Get()->Execute(fmt::format("banadd uid={} time={} banreason={}", uid, seconds, reasonmsg));
-	return true;
+	return CNetwork::Get()->Execute(fmt::format("banadd uid={} time={} banreason={}",
+		Escaped(uid), seconds, Escaped(reasonmsg)),
+		CNetwork::ReadCallback_t(), ECommandPriority::INTERACTIVE);
 }
 
-bool CServer::MoveClient(Client::Id_t clid, Channel::Id_t cid)
+CServer::CommandId_t CServer::MoveClient(Client::Id_t clid, Channel::Id_t cid)
 {
 	if (IsValidClient(clid) == false)
-		return false;
+		return 0;
 
 	if (IsValidChannel(cid) == false)
-		return false;
+		return 0;
 
 
-	CNetwork::Get()->Execute(fmt::format("clientmove clid={} cid={}", clid, cid));
-	return true;
+	return CNetwork::Get()->Execute(fmt::format("clientmove clid={} cid={}", clid, cid),
+		CNetwork::ReadCallback_t(), ECommandPriority::INTERACTIVE);
 }
 
-bool CServer::SetClientChannelGroup(Client::Id_t clid, int groupid, Channel::Id_t cid)
+CServer::CommandId_t CServer::SetClientChannelGroup(Client::Id_t clid, int groupid, Channel::Id_t cid)
 {
 	if (IsValidClient(clid) == false)
-		return false;
+		return 0;
 
 	if (IsValidChannel(cid) == false)
-		return false;
+		return 0;
 
 
-	boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
-	Client::Id_t dbid = m_Clients.at(clid)->DatabaseId;
-	CNetwork::Get()->Execute(fmt::format("setclientchannelgroup cgid={} cid={} cldbid={}", groupid, cid, dbid));
-	return true;
+	Client::Id_t dbid = GetClientDatabaseId(clid);
+	return CNetwork::Get()->Execute(fmt::format("setclientchannelgroup cgid={} cid={} cldbid={}", groupid, cid, dbid),
+		CNetwork::ReadCallback_t(), ECommandPriority::INTERACTIVE);
 }
 
-bool CServer::AddClientToServerGroup(Client::Id_t clid, int groupid)
+CServer::CommandId_t CServer::AddClientToServerGroup(Client::Id_t clid, int groupid)
 {
 	if (IsValidClient(clid) == false)
-		return false;
+		return 0;
 
 
-	boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
-	Client::Id_t dbid = m_Clients.at(clid)->DatabaseId;
-	CNetwork::Get()->Execute(fmt::format("servergroupaddclient sgid={} cldbid={}", groupid, dbid));
-	return true;
+	Client::Id_t dbid = GetClientDatabaseId(clid);
+	return CNetwork::Get()->Execute(fmt::format("servergroupaddclient sgid={} cldbid={}", groupid, dbid),
+		CNetwork::ReadCallback_t(), ECommandPriority::INTERACTIVE);
 }
 
-bool CServer::RemoveClientFromServerGroup(Client::Id_t clid, int groupid)
+CServer::CommandId_t CServer::RemoveClientFromServerGroup(Client::Id_t clid, int groupid)
 {
 	if (IsValidClient(clid) == false)
-		return false;
+		return 0;
 
 
-	boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
-	Client::Id_t dbid = m_Clients.at(clid)->DatabaseId;
-	CNetwork::Get()->Execute(fmt::format("servergroupdelclient sgid={} cldbid={}", groupid, dbid));
-	return true;
+	Client::Id_t dbid = GetClientDatabaseId(clid);
+	return CNetwork::Get()->Execute(fmt::format("servergroupdelclient sgid={} cldbid={}", groupid, dbid),
+		CNetwork::ReadCallback_t(), ECommandPriority::INTERACTIVE);
 }
 
-bool CServer::SetClientTalkerStatus(Client::Id_t clid, bool status)
+CServer::CommandId_t CServer::SetClientTalkerStatus(Client::Id_t clid, bool status)
 {
-	if (IsValidClient(clid) == false)
-		return false;
-
-
-	boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
-	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
+	CacheSnapshot_t snapshot = GetSnapshot();
+	const ClientTable::Slot_t client_slot = snapshot->Clients.Find(clid);
+	if (client_slot == ClientTable::NoSlot)
+		return 0;
 
-	Channel::Id_t cid = m_Clients.at(clid)->CurrentChannel;
-	if (m_Channels.at(cid)->RequiredTalkPower == 0)
-		return false;
+	const ChannelTable::Slot_t channel_slot = snapshot->Channels.Find(snapshot->Clients.CurrentChannel[client_slot]);
+	if (channel_slot == ChannelTable::NoSlot || snapshot->Channels.RequiredTalkPower[channel_slot] == 0)
+		return 0;
 
-	CNetwork::Get()->Execute(fmt::format(
-		"clientedit clid={} client_is_talker={}", clid, status ? 1 : 0));
-	return true;
+	return CNetwork::Get()->Execute(fmt::format(
+		"clientedit clid={} client_is_talker={}", clid, status ? 1 : 0),
+		CNetwork::ReadCallback_t(), ECommandPriority::INTERACTIVE);
 }
 
-bool CServer::SetClientDescription(Client::Id_t clid, string desc)
+CServer::CommandId_t CServer::SetClientDescription(Client::Id_t clid, string desc)
 {
 	if (IsValidClient(clid) == false)
-		return false;
+		return 0;
 
 
-	CUtils::Get()->EscapeString(desc);
-	CNetwork::Get()->Execute(fmt::format(
-		"clientedit clid={} client_description={}", clid, desc));
-	return true;
+	return CNetwork::Get()->Execute(fmt::format(
+		"clientedit clid={} client_description={}", clid, Escaped(desc)));
 }
 
-bool CServer::PokeClient(Client::Id_t clid, string msg)
+CServer::CommandId_t CServer::PokeClient(Client::Id_t clid, string msg)
 {
 	if (IsValidClient(clid) == false)
-		return false;
+		return 0;
 
 
-	CUtils::Get()->EscapeString(msg);
-	CNetwork::Get()->Execute(fmt::format("clientpoke clid={} msg={}", clid, msg));
-	return true;
+	return CNetwork::Get()->Execute(fmt::format("clientpoke clid={} msg={}", clid, Escaped(msg)),
+		CNetwork::ReadCallback_t(), ECommandPriority::INTERACTIVE);
 }
 
-bool CServer::SendClientMessage(Client::Id_t clid, string msg)
+CServer::CommandId_t CServer::SendClientMessage(Client::Id_t clid, string msg)
 {
 	if (IsValidClient(clid) == false)
-		return false;
+		return 0;
 
 
-	CUtils::Get()->EscapeString(msg);
-	CNetwork::Get()->Execute(fmt::format("sendtextmessage targetmode=1 target={} msg={}", clid, msg));
-	return true;
+	return CNetwork::Get()->Execute(fmt::format("sendtextmessage targetmode=1 target={} msg={}", clid, Escaped(msg)),
+		CNetwork::ReadCallback_t(), ECommandPriority::INTERACTIVE);
 }
 
 
 
 
-void CServer::OnLogin(vector<string> &res)
+void CServer::OnLogin(vector<boost::string_ref> &res)
 {
-	Initialize();
-	m_IsLoggedIn = true;
-
+	//logged in again after the connection was lost, the cache survived that;
+	//if the first lists didn't arrive before, there's nothing to diff against yet
+	if (m_IsInitialized)
+	{
+		Synchronize(m_IsLoggedIn || m_IsWarmStart);
+		return;
+	}
 
-	CCallbackHandler::Get()->Call("TSC_OnConnect");
+	m_IsInitialized = true;
+	Initialize();
+	//a cache loaded from the cache file is diffed against the lists like after a
+	//reconnect, the differences are reported through the usual callbacks
+	Synchronize(m_IsWarmStart);
 }
 
-void CServer::OnChannelList(vector<string> &res)
+void CServer::OnChannelListRow(boost::string_ref row)
 {
 	/*
 	data (newline = space):
@@ -925,95 +1319,273 @@ void CServer::OnChannelList(vector<string> &res)
 		....
 		channel_maxclients=-1
 	*/
+	unsigned int
+		cid = 0,
+		pid = 0,
+		order = 0,
+		is_default = 0,
+		has_password = 0,
+		is_permanent = 0,
+		is_semi_perm = 0;
+
+	int
+		max_clients = -1,
+		needed_talkpower = 0;
+
+	string name;
+
+	const CSchemaRow<ChannelListRow> fields(row);
+	fields.Get(ChannelListRow::cid, cid);
+	fields.Get(ChannelListRow::pid, pid);
+	fields.Get(ChannelListRow::channel_order, order);
+	fields.Get(ChannelListRow::channel_name, name);
+	fields.Get(ChannelListRow::channel_flag_default, is_default);
+	fields.Get(ChannelListRow::channel_flag_password, has_password);
+	fields.Get(ChannelListRow::channel_flag_permanent, is_permanent);
+	fields.Get(ChannelListRow::channel_flag_semi_permanent, is_semi_perm);
+	fields.Get(ChannelListRow::channel_maxclients, max_clients);
+	fields.Get(ChannelListRow::channel_needed_talk_power, needed_talkpower);
+
+	CUtils::Get()->UnEscapeString(name);
+
+
+	Channel chan;
+	chan.ParentId = pid;
+	chan.OrderId = order;
+	chan.Name = boost::move(name);
+	chan.HasPassword = has_password != 0;
+	if (is_permanent != 0)
+		chan.Type = Channel::Types::PERMANENT;
+	else if (is_semi_perm != 0)
+		chan.Type = Channel::Types::SEMI_PERMANENT;
+	else
+		chan.Type = Channel::Types::TEMPORARY;
+	chan.MaxClients = max_clients;
+	chan.RequiredTalkPower = needed_talkpower;
+
+	if (is_default != 0)
+		m_SyncDefaultChannel = cid;
+	m_SyncChannels[cid] = boost::move(chan);
+}
+
+void CServer::OnChannelList(bool resync)
+{
+	unordered_map<Channel::Id_t, Channel> channels;
+	channels.swap(m_SyncChannels);
+
 	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-	for (auto &res_row : res)
+	MarkCacheChanged();
+	const Channel::Id_t default_channel = m_SyncDefaultChannel != Channel::Invalid
+		? m_SyncDefaultChannel : m_DefaultChannel;
+
+	if (resync == false)
+	{
+		//the channels of a synchronization interrupted by a lost connection are replaced
+		vector<Channel::Id_t> old_channels;
+		m_Channels.ForEach([&](Channel::Id_t cid, ChannelTable::Slot_t)
+		{
+			old_channels.push_back(cid);
+		});
+		for (Channel::Id_t cid : old_channels)
+			RemoveChannel(cid);
+
+		m_DefaultChannel = default_channel;
+		for (auto &c : channels)
+			AddChannel(c.first, c.second);
+		RebuildChannelTree();
+		return;
+	}
+
+
+	vector<Channel::Id_t> deleted_channels;
+	m_Channels.ForEach([&](Channel::Id_t cid, ChannelTable::Slot_t)
+	{
+		if (channels.find(cid) == channels.end())
+			deleted_channels.push_back(cid);
+	});
+	for (Channel::Id_t cid : deleted_channels)
+	{
+		RemoveChannel(cid);
+		CCallbackHandler::Get()->Call("TSC_OnChannelDeleted", cid);
+	}
+
+	for (auto &c : channels)
+	{
+		const Channel::Id_t cid = c.first;
+		const Channel &new_chan = c.second;
+
+		const ChannelTable::Slot_t slot = m_Channels.Find(cid);
+		if (slot == ChannelTable::NoSlot)
+		{
+			AddChannel(cid, new_chan);
+			CCallbackHandler::Get()->Call("TSC_OnChannelCreated", cid);
+			continue;
+		}
+
+		if (m_Channels.GetName(slot) != new_chan.Name)
+		{
+			RenameChannel(cid, new_chan.Name);
+			CCallbackHandler::Get()->Call("TSC_OnChannelRenamed", cid, new_chan.Name);
+		}
+		if (m_Channels.ParentId[slot] != new_chan.ParentId)
+		{
+			m_Channels.ParentId[slot] = new_chan.ParentId;
+			m_Channels.OrderId[slot] = new_chan.OrderId;
+			CCallbackHandler::Get()->Call("TSC_OnChannelMoved", cid, new_chan.ParentId, new_chan.OrderId);
+		}
+		else if (m_Channels.OrderId[slot] != new_chan.OrderId)
+		{
+			m_Channels.OrderId[slot] = new_chan.OrderId;
+			CCallbackHandler::Get()->Call("TSC_OnChannelReorder", cid, new_chan.OrderId);
+		}
+		if (m_Channels.HasFlag(slot, ChannelTable::HAS_PASSWORD) != new_chan.HasPassword)
+		{
+			m_Channels.SetFlag(slot, ChannelTable::HAS_PASSWORD, new_chan.HasPassword);
+			//forward TSC_OnChannelPasswordEdited(channelid, bool:ispassworded, bool:passwordchanged);
+			CCallbackHandler::Get()->Call("TSC_OnChannelPasswordEdited", cid, new_chan.HasPassword ? 1 : 0, 0);
+		}
+		if (m_Channels.Type[slot] != new_chan.Type)
+		{
+			m_Channels.Type[slot] = new_chan.Type;
+			CCallbackHandler::Get()->Call("TSC_OnChannelTypeChanged", cid, static_cast<int>(new_chan.Type));
+		}
+		if (m_Channels.MaxClients[slot] != new_chan.MaxClients)
+		{
+			m_Channels.MaxClients[slot] = new_chan.MaxClients;
+			CCallbackHandler::Get()->Call("TSC_OnChannelMaxClientsChanged", cid, new_chan.MaxClients);
+		}
+		if (m_Channels.RequiredTalkPower[slot] != new_chan.RequiredTalkPower)
+		{
+			m_Channels.RequiredTalkPower[slot] = new_chan.RequiredTalkPower;
+			CCallbackHandler::Get()->Call("TSC_OnChannelRequiredTPChanged", cid, new_chan.RequiredTalkPower);
+		}
+		m_Channels.SetFlag(slot, ChannelTable::WAS_PASSWORD_TOGGLED, false);
+	}
+	RebuildChannelTree();
+
+	if (m_DefaultChannel != default_channel)
+	{
+		m_DefaultChannel = default_channel;
+		CCallbackHandler::Get()->Call("TSC_OnChannelSetDefault", m_DefaultChannel);
+	}
+}
+
+void CServer::OnClientListRow(boost::string_ref row, bool resync)
+{
+	Client::Id_t
+		id = Client::Invalid,
+		dbid = Client::Invalid;
+	Channel::Id_t cid = Channel::Invalid;
+	string uid, ip, nickname;
+	int type = 0;
+
+	const CSchemaRow<ClientListRow> fields(row);
+	fields.Get(ClientListRow::clid, id);
+	fields.Get(ClientListRow::cid, cid);
+	fields.Get(ClientListRow::client_database_id, dbid);
+	fields.Get(ClientListRow::client_nickname, nickname);
+	fields.Get(ClientListRow::client_type, type);
+	fields.Get(ClientListRow::client_unique_identifier, uid);
+	fields.Get(ClientListRow::connection_client_ip, ip);
+
+	CUtils::Get()->UnEscapeString(uid);
+
+	Client client;
+	client.DatabaseId = dbid;
+	client.Uid = boost::move(uid);
+	client.IpAddress = boost::move(ip);
+	client.CurrentChannel = cid;
+
+	m_SyncClients[id] = boost::move(client);
+	if (resync)
 	{
-		unsigned int
-			cid = 0,
-			pid = 0,
-			order = 0,
-			is_default = 0,
-			has_password = 0,
-			is_permanent = 0,
-			is_semi_perm = 0;
-
-		int
-			max_clients = -1,
-			needed_talkpower = 0;
-
-		string name;
-
-		CUtils::Get()->ParseField(res_row, "cid", cid);
-		CUtils::Get()->ParseField(res_row, "pid", pid);
-		CUtils::Get()->ParseField(res_row, "channel_order", order);
-		CUtils::Get()->ParseField(res_row, "channel_name", name);
-		CUtils::Get()->ParseField(res_row, "channel_flag_default", is_default);
-		CUtils::Get()->ParseField(res_row, "channel_flag_password", has_password);
-		CUtils::Get()->ParseField(res_row, "channel_flag_permanent", is_permanent);
-		CUtils::Get()->ParseField(res_row, "channel_flag_semi_permanent", is_semi_perm);
-		CUtils::Get()->ParseField(res_row, "channel_maxclients", max_clients);
-		CUtils::Get()->ParseField(res_row, "channel_needed_talk_power", needed_talkpower);
-
-		CUtils::Get()->UnEscapeString(name);
-
-
-		Channel_t chan(new Channel);
-		chan->ParentId = pid;
-		chan->OrderId = order;
-		chan->Name = name;
-		chan->HasPassword = has_password != 0;
-		if (is_permanent != 0)
-			chan->Type = Channel::Types::PERMANENT;
-		else if (is_semi_perm != 0)
-			chan->Type = Channel::Types::SEMI_PERMANENT;
-		else
-			chan->Type = Channel::Types::TEMPORARY;
-		chan->MaxClients = max_clients;
-		chan->RequiredTalkPower = needed_talkpower;
-
-		if (is_default != 0)
-			m_DefaultChannel = cid;
-		m_Channels.emplace(cid, chan);
+		CUtils::Get()->UnEscapeString(nickname);
+		m_SyncNicknames[id] = boost::move(nickname);
 	}
 }
 
-void CServer::OnClientList(vector<string> &res)
+void CServer::OnClientList(bool resync)
 {
+	unordered_map<Client::Id_t, Client> clients;
+	unordered_map<Client::Id_t, string> nicknames;
+	clients.swap(m_SyncClients);
+	nicknames.swap(m_SyncNicknames);
+
 	boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
-	for (auto &r : res)
+	MarkCacheChanged();
+
+	if (resync == false)
+	{
+		vector<Client::Id_t> old_clients;
+		m_Clients.ForEach([&](Client::Id_t clid, ClientTable::Slot_t)
+		{
+			old_clients.push_back(clid);
+		});
+		for (Client::Id_t clid : old_clients)
+			RemoveClient(clid);
+
+		for (auto &c : clients)
+			AddClient(c.first, c.second);
+
+		//the cache is filled, we're ready to go
+		m_IsLoggedIn = true;
+		CCallbackHandler::Get()->Call("TSC_OnConnect");
+		return;
+	}
+
+
+	//client ids are reused, so a different uid means the old client left
+	vector<Client::Id_t> left_clients;
+	m_Clients.ForEach([&](Client::Id_t clid, ClientTable::Slot_t slot)
+	{
+		auto new_it = clients.find(clid);
+		if (new_it == clients.end() || new_it->second.Uid != m_Clients.GetUid(slot))
+			left_clients.push_back(clid);
+	});
+	for (Client::Id_t clid : left_clients)
+	{
+		RemoveClient(clid);
+		//reasonid 8: left the server
+		CCallbackHandler::Get()->Call("TSC_OnClientDisconnect", clid, 8, string());
+	}
+
+	for (auto &c : clients)
+	{
+		const Client::Id_t clid = c.first;
+		const Client &new_client = c.second;
+
+		const ClientTable::Slot_t slot = m_Clients.Find(clid);
+		if (slot == ClientTable::NoSlot)
+		{
+			AddClient(clid, new_client);
+			CCallbackHandler::Get()->Call("TSC_OnClientConnect", clid, nicknames[clid]);
+			continue;
+		}
+
+		m_Clients.DatabaseId[slot] = new_client.DatabaseId;
+		SetClientIpAddress(clid, new_client.IpAddress);
+		if (m_Clients.CurrentChannel[slot] != new_client.CurrentChannel)
+		{
+			SetClientChannel(clid, new_client.CurrentChannel);
+			CCallbackHandler::Get()->Call("TSC_OnClientMoved", clid, new_client.CurrentChannel, 0);
+		}
+	}
+
+	//the cache of a warm start is correct now
+	if (m_IsLoggedIn == false)
 	{
-		Client::Id_t
-			id = Client::Invalid,
-			dbid = Client::Invalid;
-		Channel::Id_t cid = Channel::Invalid;
-		string uid, ip;
-		int type = 0;
-
-		CUtils::Get()->ParseField(r, "clid", id);
-		CUtils::Get()->ParseField(r, "cid", cid);
-		CUtils::Get()->ParseField(r, "client_database_id", dbid);
-		CUtils::Get()->ParseField(r, "client_unique_identifier", uid);
-		CUtils::Get()->ParseField(r, "client_type", type);
-		CUtils::Get()->ParseField(r, "connection_client_ip", ip);
-
-		CUtils::Get()->UnEscapeString(uid);
-
-		Client_t client(new Client);
-		client->DatabaseId = dbid;
-		client->Uid = uid;
-		client->IpAddress = ip;
-		client->CurrentChannel = cid;
-
-		m_Clients.emplace(id, client);
+		m_IsLoggedIn = true;
+		CCallbackHandler::Get()->Call("TSC_OnConnect");
 	}
 }
 
 
 
-void CServer::OnChannelCreated(boost::smatch &result)
+void CServer::OnChannelCreated(const CResultRow &row)
 {
-	unsigned int
-		id = 0,
+	const CSchemaRow<ChannelCreatedNotify> fields(row);
+	Channel::Id_t
+		id = Channel::Invalid,
 		parent_id = 0,
 		order_id = 0;
 	int
@@ -1022,21 +1594,23 @@ void CServer::OnChannelCreated(boost::smatch &result)
 	Channel::Types type = Channel::Types::INVALID;
 	string name;
 
-	CUtils::Get()->ConvertStringToInt(result[1].str(), id);
-	CUtils::Get()->ConvertStringToInt(result[2].str(), parent_id);
-	name = result[3].str();
-
-	string extra_data(result[4].str());
-
-	CUtils::Get()->ParseField(extra_data, "channel_order", order_id);
-	CUtils::Get()->ParseField(extra_data, "channel_maxclients", maxclients);
-	CUtils::Get()->ParseField(extra_data, "channel_needed_talk_power", needed_talkpower);
+	if (fields.Get(ChannelCreatedNotify::cid, id) == false)
+		return;
+	fields.Get(ChannelCreatedNotify::cpid, parent_id);
+	fields.Get(ChannelCreatedNotify::channel_name, name);
+	fields.Get(ChannelCreatedNotify::channel_order, order_id);
+	fields.Get(ChannelCreatedNotify::channel_maxclients, maxclients);
+	fields.Get(ChannelCreatedNotify::channel_needed_talk_power, needed_talkpower);
 
 	int
 		is_permanent = 0,
-		is_semi_perm = 0;
-	CUtils::Get()->ParseField(extra_data, "channel_flag_permanent", is_permanent);
-	CUtils::Get()->ParseField(extra_data, "channel_flag_semi_permanent", is_semi_perm);
+		is_semi_perm = 0,
+		has_password = 0,
+		is_default = 0;
+	fields.Get(ChannelCreatedNotify::channel_flag_permanent, is_permanent);
+	fields.Get(ChannelCreatedNotify::channel_flag_semi_permanent, is_semi_perm);
+	fields.Get(ChannelCreatedNotify::channel_flag_password, has_password);
+	fields.Get(ChannelCreatedNotify::channel_flag_default, is_default);
 	if (is_permanent != 0)
 		type = Channel::Types::PERMANENT;
 	else if (is_semi_perm != 0)
@@ -1047,247 +1621,282 @@ void CServer::OnChannelCreated(boost::smatch &result)
 
 	CUtils::Get()->UnEscapeString(name);
 
-	Channel_t chan(new Channel);
-	chan->ParentId = parent_id;
-	chan->OrderId = order_id;
-	chan->Name = name;
-	chan->Type = type;
-	chan->HasPassword = (extra_data.find("channel_flag_password") != string::npos);
-	chan->MaxClients = maxclients;
-	chan->RequiredTalkPower = needed_talkpower;
+	Channel chan;
+	chan.ParentId = parent_id;
+	chan.OrderId = order_id;
+	chan.Name = boost::move(name);
+	chan.Type = type;
+	chan.HasPassword = (has_password != 0);
+	chan.MaxClients = maxclients;
+	chan.RequiredTalkPower = needed_talkpower;
 
-	if (extra_data.find("channel_flag_default") != string::npos)
+	if (is_default != 0)
 		m_DefaultChannel = id;
 
 	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-	m_Channels.emplace(id, chan);
+	MarkCacheChanged();
+	if (AddChannel(id, chan))
+		LinkChannel(id);
 
 
 	CCallbackHandler::Get()->Call("TSC_OnChannelCreated", id);
 }
 
-void CServer::OnChannelDeleted(boost::smatch &result)
+void CServer::OnChannelDeleted(const CResultRow &row)
 {
-	unsigned int cid = 0;
-	CUtils::Get()->ConvertStringToInt(result[1].str(), cid);
+	const CSchemaRow<ChannelIdNotify> fields(row);
+	Channel::Id_t cid = Channel::Invalid;
+	fields.Get(ChannelIdNotify::cid, cid);
 
-	if (IsValidChannel(cid) == false)
+	if (HasChannel(cid) == false)
 		return;
 
 
 	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-	m_Channels.erase(cid);
+	MarkCacheChanged();
+	RemoveChannel(cid);
 
 
 	CCallbackHandler::Get()->Call("TSC_OnChannelDeleted", cid);
 }
 
-void CServer::OnChannelReorder(boost::smatch &result)
+void CServer::OnChannelEdited(const CResultRow &row)
 {
-	unsigned int
-		cid = 0,
+	const CSchemaRow<ChannelEditedNotify> fields(row);
+	int reasonid = -1;
+	if (fields.Get(ChannelEditedNotify::reasonid, reasonid) == false || reasonid != 10)
+		return;
+
+	//one notify carries every property changed at once
+	if (fields.Has(ChannelEditedNotify::channel_order))
+		OnChannelReorder(fields);
+	if (fields.Has(ChannelEditedNotify::channel_name))
+		OnChannelRenamed(fields);
+	if (fields.Has(ChannelEditedNotify::channel_flag_password))
+		OnChannelPasswordToggled(fields);
+	if (fields.Has(ChannelEditedNotify::channel_flag_permanent)
+		|| fields.Has(ChannelEditedNotify::channel_flag_semi_permanent))
+		OnChannelTypeChanged(fields);
+	if (fields.Has(ChannelEditedNotify::channel_flag_default))
+		OnChannelSetDefault(fields);
+	if (fields.Has(ChannelEditedNotify::channel_maxclients))
+		OnChannelMaxClientsChanged(fields);
+	if (fields.Has(ChannelEditedNotify::channel_needed_talk_power))
+		OnChannelRequiredTalkPowerChanged(fields);
+}
+
+void CServer::OnChannelReorder(const CSchemaRow<ChannelEditedNotify> &fields)
+{
+	Channel::Id_t
+		cid = Channel::Invalid,
 		orderid = 0;
 
-	CUtils::Get()->ConvertStringToInt(result[1].str(), cid);
-	CUtils::Get()->ConvertStringToInt(result[2].str(), orderid);
+	fields.Get(ChannelEditedNotify::cid, cid);
+	fields.Get(ChannelEditedNotify::channel_order, orderid);
 
-	if (orderid != 0 && IsValidChannel(orderid) == false)
+	if (orderid != 0 && HasChannel(orderid) == false)
 		return;
 
-	if (IsValidChannel(cid) == false)
+	if (HasChannel(cid) == false)
 		return;
 	
 
 	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-	m_Channels.at(cid)->OrderId = orderid;
+	MarkCacheChanged();
+	const ChannelTable::Slot_t slot = m_Channels.Find(cid);
+	MoveChannel(cid, m_Channels.ParentId[slot], orderid);
 
 
 	CCallbackHandler::Get()->Call("TSC_OnChannelReorder", cid, orderid);
 }
 
-void CServer::OnChannelMoved(boost::smatch &result)
+void CServer::OnChannelMoved(const CResultRow &row)
 {
-	unsigned int
-		cid = 0,
+	const CSchemaRow<ChannelMovedNotify> fields(row);
+	Channel::Id_t
+		cid = Channel::Invalid,
 		parentid = 0,
 		orderid = 0;
+	int reasonid = -1;
 
-	CUtils::Get()->ConvertStringToInt(result[1].str(), cid);
-	CUtils::Get()->ConvertStringToInt(result[2].str(), parentid);
-	CUtils::Get()->ConvertStringToInt(result[3].str(), orderid);
+	if (fields.Get(ChannelMovedNotify::reasonid, reasonid) == false || reasonid != 1)
+		return;
+
+	fields.Get(ChannelMovedNotify::cid, cid);
+	fields.Get(ChannelMovedNotify::cpid, parentid);
+	fields.Get(ChannelMovedNotify::order, orderid);
 
-	if (orderid != 0 && IsValidChannel(orderid) == false)
+	if (orderid != 0 && HasChannel(orderid) == false)
 		return;
 
-	if (parentid != 0 && IsValidChannel(parentid) == false)
+	if (parentid != 0 && HasChannel(parentid) == false)
 		return;
 
-	if (IsValidChannel(cid) == false)
+	if (HasChannel(cid) == false)
 		return;
 	
 
 	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-	Channel_t &channel = m_Channels.at(cid);
-	channel->ParentId = parentid;
-	channel->OrderId = orderid;
+	MarkCacheChanged();
+	MoveChannel(cid, parentid, orderid);
 
 	
 	CCallbackHandler::Get()->Call("TSC_OnChannelMoved", cid, parentid, orderid);
 }
 
-void CServer::OnChannelRenamed(boost::smatch &result)
+void CServer::OnChannelRenamed(const CSchemaRow<ChannelEditedNotify> &fields)
 {
-	unsigned int cid = 0;
+	Channel::Id_t cid = Channel::Invalid;
 	string name;
 
-	CUtils::Get()->ConvertStringToInt(result[1].str(), cid);
-	name = result[2].str();
+	fields.Get(ChannelEditedNotify::cid, cid);
+	fields.Get(ChannelEditedNotify::channel_name, name);
 	CUtils::Get()->UnEscapeString(name);
 
-	if (IsValidChannel(cid) == false)
+	if (HasChannel(cid) == false)
 		return;
 
 
 	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-	m_Channels.at(cid)->Name = name;
+	MarkCacheChanged();
+	RenameChannel(cid, name);
 
 	
 	CCallbackHandler::Get()->Call("TSC_OnChannelRenamed", cid, name);
 }
 
-void CServer::OnChannelPasswordToggled(boost::smatch &result)
+void CServer::OnChannelPasswordToggled(const CSchemaRow<ChannelEditedNotify> &fields)
 {
-	unsigned int
-		cid = 0,
-		toggle_password = 0;
+	Channel::Id_t cid = Channel::Invalid;
+	unsigned int toggle_password = 0;
 	
-	CUtils::Get()->ConvertStringToInt(result[1].str(), cid);
-	CUtils::Get()->ConvertStringToInt(result[2].str(), toggle_password);
+	fields.Get(ChannelEditedNotify::cid, cid);
+	fields.Get(ChannelEditedNotify::channel_flag_password, toggle_password);
 
-	if (IsValidChannel(cid) == false)
+	if (HasChannel(cid) == false)
 		return;
 
 
 	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-	Channel_t &channel = m_Channels.at(cid);
-	channel->HasPassword = (toggle_password != 0);
-	channel->WasPasswordToggled = true;
+	MarkCacheChanged();
+	const ChannelTable::Slot_t slot = m_Channels.Find(cid);
+	m_Channels.SetFlag(slot, ChannelTable::HAS_PASSWORD, toggle_password != 0);
+	m_Channels.SetFlag(slot, ChannelTable::WAS_PASSWORD_TOGGLED, true);
 
 	
 	//forward TSC_OnChannelPasswordEdited(channelid, bool:ispassworded, bool:passwordchanged);
 	CCallbackHandler::Get()->Call("TSC_OnChannelPasswordEdited", cid, toggle_password, 0);
 }
 
-void CServer::OnChannelPasswordChanged(boost::smatch &result)
+void CServer::OnChannelPasswordChanged(const CResultRow &row)
 {
-	unsigned int cid = 0;
-	CUtils::Get()->ConvertStringToInt(result[1].str(), cid);
+	const CSchemaRow<ChannelIdNotify> fields(row);
+	Channel::Id_t cid = Channel::Invalid;
+	fields.Get(ChannelIdNotify::cid, cid);
 
-	if (IsValidChannel(cid) == false)
+	if (HasChannel(cid) == false)
 		return;
 
 
 	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-	Channel_t &channel = m_Channels.at(cid);
-	if (channel->WasPasswordToggled == false)
+	MarkCacheChanged();
+	const ChannelTable::Slot_t slot = m_Channels.Find(cid);
+	if (m_Channels.HasFlag(slot, ChannelTable::WAS_PASSWORD_TOGGLED) == false)
 	{
 		//forward TSC_OnChannelPasswordEdited(channelid, bool:ispassworded, bool:passwordchanged);
 		CCallbackHandler::Get()->Call("TSC_OnChannelPasswordEdited", cid, 1, 1);
 	}
 	else
-		channel->WasPasswordToggled = false;
+		m_Channels.SetFlag(slot, ChannelTable::WAS_PASSWORD_TOGGLED, false);
 }
 
-void CServer::OnChannelTypeChanged(boost::smatch &result)
+void CServer::OnChannelTypeChanged(const CSchemaRow<ChannelEditedNotify> &fields)
 {
-	unsigned int cid = 0;
-	string
-		flag,
-		sec_flag;
+	Channel::Id_t cid = Channel::Invalid;
 	unsigned int
-		flag_data = 0,
-		sec_flag_data = 0;
+		is_permanent = 0,
+		is_semi_perm = 0;
 	
-	CUtils::Get()->ConvertStringToInt(result[1].str(), cid);
-	flag = result[2].str();
-	CUtils::Get()->ConvertStringToInt(result[3].str(), flag_data);
-	sec_flag = result[4].str();
-	CUtils::Get()->ConvertStringToInt(result[5].str(), sec_flag_data);
+	fields.Get(ChannelEditedNotify::cid, cid);
+	fields.Get(ChannelEditedNotify::channel_flag_permanent, is_permanent);
+	fields.Get(ChannelEditedNotify::channel_flag_semi_permanent, is_semi_perm);
 
-	if (IsValidChannel(cid) == false)
+	if (HasChannel(cid) == false)
 		return;
 
 
 	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-	Channel_t &channel = m_Channels.at(cid);
-	if (flag_data != 0)
-	{
-		channel->Type = (flag.find("semi_") == 0)
-			? Channel::Types::SEMI_PERMANENT
-			: Channel::Types::PERMANENT;
-	}
-	else if (sec_flag_data != 0)
-	{
-		channel->Type = (sec_flag.find("semi_") == 0)
-			? Channel::Types::SEMI_PERMANENT
-			: Channel::Types::PERMANENT;
-	}
+	MarkCacheChanged();
+	const ChannelTable::Slot_t slot = m_Channels.Find(cid);
+	Channel::Types &type = m_Channels.Type[slot];
+	if (is_permanent != 0)
+		type = Channel::Types::PERMANENT;
+	else if (is_semi_perm != 0)
+		type = Channel::Types::SEMI_PERMANENT;
 	else
-		channel->Type = Channel::Types::TEMPORARY;
+		type = Channel::Types::TEMPORARY;
 
 	
-	CCallbackHandler::Get()->Call("TSC_OnChannelTypeChanged", cid, static_cast<int>(channel->Type));
+	CCallbackHandler::Get()->Call("TSC_OnChannelTypeChanged", cid, static_cast<int>(type));
 }
 
-void CServer::OnChannelSetDefault(boost::smatch &result)
+void CServer::OnChannelSetDefault(const CSchemaRow<ChannelEditedNotify> &fields)
 {
-	unsigned int cid = 0;
-	CUtils::Get()->ConvertStringToInt(result[1].str(), cid);
+	Channel::Id_t cid = Channel::Invalid;
+	int is_default = 0;
 
-	if (IsValidChannel(cid) == false)
+	fields.Get(ChannelEditedNotify::cid, cid);
+	fields.Get(ChannelEditedNotify::channel_flag_default, is_default);
+
+	if (is_default == 0 || HasChannel(cid) == false)
 		return;
 
 
 	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
+	MarkCacheChanged();
 	m_DefaultChannel = cid;
 
 	
 	CCallbackHandler::Get()->Call("TSC_OnChannelSetDefault", cid);
 }
 
-void CServer::OnChannelMaxClientsChanged(boost::smatch &result)
+void CServer::OnChannelMaxClientsChanged(const CSchemaRow<ChannelEditedNotify> &fields)
 {
-	unsigned int cid = 0;
+	Channel::Id_t cid = Channel::Invalid;
 	int maxclients = 0;
 
-	CUtils::Get()->ConvertStringToInt(result[1].str(), cid);
-	CUtils::Get()->ConvertStringToInt(result[2].str(), maxclients);
+	fields.Get(ChannelEditedNotify::cid, cid);
+	fields.Get(ChannelEditedNotify::channel_maxclients, maxclients);
 
-	if (IsValidChannel(cid) == false)
+	if (HasChannel(cid) == false)
 		return;
 
 
 	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-	m_Channels.at(cid)->MaxClients = maxclients;
+	MarkCacheChanged();
+	const ChannelTable::Slot_t slot = m_Channels.Find(cid);
+	m_Channels.MaxClients[slot] = maxclients;
 
 	
 	CCallbackHandler::Get()->Call("TSC_OnChannelMaxClientsChanged", cid, maxclients);
 }
 
-void CServer::OnChannelRequiredTalkPowerChanged(boost::smatch &result)
+void CServer::OnChannelRequiredTalkPowerChanged(const CSchemaRow<ChannelEditedNotify> &fields)
 {
-	unsigned int cid = 0;
+	Channel::Id_t cid = Channel::Invalid;
 	int talkpower = 0;
 
-	CUtils::Get()->ConvertStringToInt(result[1].str(), cid);
-	CUtils::Get()->ConvertStringToInt(result[2].str(), talkpower);
+	fields.Get(ChannelEditedNotify::cid, cid);
+	fields.Get(ChannelEditedNotify::channel_needed_talk_power, talkpower);
 
-	if (IsValidChannel(cid) == false)
+	if (HasChannel(cid) == false)
 		return;
 
 
 	boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-	m_Channels.at(cid)->RequiredTalkPower = talkpower;
+	MarkCacheChanged();
+	const ChannelTable::Slot_t slot = m_Channels.Find(cid);
+	m_Channels.RequiredTalkPower[slot] = talkpower;
 
 
 	CCallbackHandler::Get()->Call("TSC_OnChannelRequiredTPChanged", cid, talkpower);
@@ -1295,8 +1904,9 @@ void CServer::OnChannelRequiredTalkPowerChanged(boost::smatch &result)
 
 
 
-void CServer::OnClientConnect(boost::smatch &result)
+void CServer::OnClientConnect(const CResultRow &row)
 {
+	const CSchemaRow<ClientEnterViewNotify> fields(row);
 	Client::Id_t
 		clid = Client::Invalid,
 		dbid = Client::Invalid;
@@ -1304,115 +1914,135 @@ void CServer::OnClientConnect(boost::smatch &result)
 		uid,
 		nickname;
 	Channel::Id_t cid = Channel::Invalid;
-	int type = 0;
+	int
+		from_cid = -1,
+		reasonid = -1,
+		type = 0;
+
+	//only clients connecting to the server, not those switching into our view
+	if (fields.Get(ClientEnterViewNotify::cfid, from_cid) == false || from_cid != 0
+		|| fields.Get(ClientEnterViewNotify::reasonid, reasonid) == false || reasonid != 0)
+		return;
 
-	CUtils::Get()->ConvertStringToInt(result[1].str(), cid);
-	CUtils::Get()->ConvertStringToInt(result[2].str(), clid);
-	uid = result[3].str();
-	nickname = result[4].str();
-	CUtils::Get()->ConvertStringToInt(result[5].str(), dbid);
-	CUtils::Get()->ConvertStringToInt(result[6].str(), type);
+	fields.Get(ClientEnterViewNotify::ctid, cid);
+	fields.Get(ClientEnterViewNotify::clid, clid);
+	fields.Get(ClientEnterViewNotify::client_unique_identifier, uid);
+	fields.Get(ClientEnterViewNotify::client_nickname, nickname);
+	fields.Get(ClientEnterViewNotify::client_database_id, dbid);
+	fields.Get(ClientEnterViewNotify::client_type, type);
 
 	CUtils::Get()->UnEscapeString(uid);
 	CUtils::Get()->UnEscapeString(nickname);
 
-	Client_t client(new Client);
-	client->DatabaseId = dbid;
-	client->Uid = uid;
-	client->CurrentChannel = cid;
+	Client client;
+	client.DatabaseId = dbid;
+	client.Uid = boost::move(uid);
+	client.CurrentChannel = cid;
 
 
 
 	CNetwork::Get()->Execute(
 		fmt::format("clientinfo clid={}", clid), 
-		[=](CNetwork::ResultSet_t &result)
+		[=](CNetwork::ResultSet_t &result) mutable
 		{
-			string ip;
-			CUtils::Get()->ParseField(result.at(0), "connection_client_ip", ip);
-			client->IpAddress = ip;
+			CSchemaRow<ClientInfoResponse>(result.at(0)).Get(ClientInfoResponse::connection_client_ip, client.IpAddress);
 
 			boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
-			m_Clients.emplace(clid, client);
+			MarkCacheChanged();
+			//a resync after a reconnect might have added the client already
+			if (AddClient(clid, client) == false)
+				return;
 
 			CCallbackHandler::Get()->Call("TSC_OnClientConnect", clid, nickname);
-		}
-	);
+		},
+		ECommandPriority::BACKGROUND);
 }
 
-void CServer::OnClientDisconnect(boost::smatch &result)
+void CServer::OnClientDisconnect(const CResultRow &row)
 {
+	const CSchemaRow<ClientLeftViewNotify> fields(row);
 	Client::Id_t clid = Client::Invalid;
-	int reasonid;
+	Channel::Id_t to_cid = Channel::Invalid;
+	int reasonid = 0;
 	string reasonmsg;
 
-	CUtils::Get()->ConvertStringToInt(result[1].str(), reasonid);
-	reasonmsg = result[2].str();
-	CUtils::Get()->ConvertStringToInt(result[3].str(), clid);
+	//clients leaving our view by switching channels still have a target channel
+	if (fields.Get(ClientLeftViewNotify::ctid, to_cid) == false || to_cid != 0)
+		return;
 
-	if (IsValidClient(clid) == false)
+	fields.Get(ClientLeftViewNotify::reasonid, reasonid);
+	fields.Get(ClientLeftViewNotify::reasonmsg, reasonmsg);
+	fields.Get(ClientLeftViewNotify::clid, clid);
+
+	if (HasClient(clid) == false)
 		return;
 
 
 	boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
-	m_Clients.erase(clid);
+	MarkCacheChanged();
+	RemoveClient(clid);
 
 
 	CUtils::Get()->UnEscapeString(reasonmsg);
 	CCallbackHandler::Get()->Call("TSC_OnClientDisconnect", clid, reasonid, reasonmsg);
 }
 
-void CServer::OnClientMoved(boost::smatch &result)
+void CServer::OnClientMoved(const CResultRow &row)
 {
-	Channel::Id_t to_cid;
-	int reasonid;
-	Client::Id_t invokerid = Client::Invalid;
+	//called once per moved client, "ctid", "reasonid" and "invokerid"
+	//are only sent in the first entry
+	const CSchemaRow<ClientMovedNotify> fields(row);
+	Channel::Id_t to_cid = Channel::Invalid;
+	Client::Id_t
+		clid = Client::Invalid,
+		invokerid = Client::Invalid;
 
-	CUtils::Get()->ConvertStringToInt(result[1].str(), to_cid);
-	CUtils::Get()->ConvertStringToInt(result[2].str(), reasonid);
-	CUtils::Get()->ConvertStringToInt(result[3].str(), invokerid);
-	string client_list(result[4].str());
+	fields.Get(ClientMovedNotify::ctid, to_cid);
+	fields.Get(ClientMovedNotify::invokerid, invokerid);
+	fields.Get(ClientMovedNotify::clid, clid);
 
 
-	if (IsValidChannel(to_cid) == false)
+	if (HasChannel(to_cid) == false)
 		return;
 
-	if (invokerid != Client::Invalid && IsValidClient(invokerid) == false)
+	if (invokerid != Client::Invalid && HasClient(invokerid) == false)
 		return;
 
-	size_t
-		delim_pos = 0,
-		old_delim_pos = 0;
-	do
-	{
-		delim_pos = client_list.find('|', delim_pos + 1);
+	if (HasClient(clid) == false)
+		return;
 
-		Client::Id_t clid = Client::Invalid;
-		CUtils::Get()->ParseField(client_list.substr(old_delim_pos, delim_pos - old_delim_pos), "clid", clid);
-		old_delim_pos = delim_pos;
 
-		if (IsValidClient(clid))
-		{
-			boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
-			m_Clients.at(clid)->CurrentChannel = to_cid;
+	boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
+	MarkCacheChanged();
+	SetClientChannel(clid, to_cid);
 
-			CCallbackHandler::Get()->Call("TSC_OnClientMoved", clid, to_cid, invokerid);
-		}
-	} while (delim_pos != string::npos);
+	CCallbackHandler::Get()->Call("TSC_OnClientMoved", clid, to_cid, invokerid);
+}
 
+void CServer::OnTextMessage(const CResultRow &row)
+{
+	const CSchemaRow<TextMessageNotify> fields(row);
+	int targetmode = 0;
+	fields.Get(TextMessageNotify::targetmode, targetmode);
+
+	if (targetmode == 3)
+		OnClientServerText(fields);
+	else if (targetmode == 1)
+		OnClientPrivateText(fields);
 }
 
-void CServer::OnClientServerText(boost::smatch &result)
+void CServer::OnClientServerText(const CSchemaRow<TextMessageNotify> &fields)
 {
 	Client::Id_t clid = Client::Invalid;
 	string
 		nickname,
 		msg;
 
-	msg = result[1].str();
-	CUtils::Get()->ConvertStringToInt(result[2].str(), clid);
-	nickname = result[3].str();
+	fields.Get(TextMessageNotify::msg, msg);
+	fields.Get(TextMessageNotify::invokerid, clid);
+	fields.Get(TextMessageNotify::invokername, nickname);
 
-	if (clid != Client::Invalid && IsValidClient(clid) == false)
+	if (clid != Client::Invalid && HasClient(clid) == false)
 		return;
 
 
@@ -1421,7 +2051,7 @@ void CServer::OnClientServerText(boost::smatch &result)
 	CCallbackHandler::Get()->Call("TSC_OnClientServerText", clid, nickname, msg);
 }
 
-void CServer::OnClientPrivateText(boost::smatch &result)
+void CServer::OnClientPrivateText(const CSchemaRow<TextMessageNotify> &fields)
 {
 	Client::Id_t
 		from_clid = Client::Invalid,
@@ -1430,13 +2060,13 @@ void CServer::OnClientPrivateText(boost::smatch &result)
 		from_nickname,
 		msg;
 
-	msg = result[1].str();
-	CUtils::Get()->ConvertStringToInt(result[2].str(), to_clid);
-	CUtils::Get()->ConvertStringToInt(result[3].str(), from_clid);
-	from_nickname = result[4].str();
+	fields.Get(TextMessageNotify::msg, msg);
+	fields.Get(TextMessageNotify::target, to_clid);
+	fields.Get(TextMessageNotify::invokerid, from_clid);
+	fields.Get(TextMessageNotify::invokername, from_nickname);
 	
 	//one of both clid's has to be invalid because it's our ServerQuery client
-	if (IsValidClient(from_clid) == false && IsValidClient(to_clid) == false)
+	if (HasClient(from_clid) == false && HasClient(to_clid) == false)
 		return;
 
 
@@ -1444,4 +2074,3 @@ void CServer::OnClientPrivateText(boost::smatch &result)
 	CUtils::Get()->UnEscapeString(msg);
 	CCallbackHandler::Get()->Call("TSC_OnClientPrivateText", from_clid, from_nickname, to_clid, msg);
 }
-
@@ -4,26 +4,28 @@
 
 
 #include <string>
-#include <list>
 #include <vector>
 #include <queue>
 #include <memory>
 #include <boost/unordered_map.hpp>
-#include <boost/regex.hpp>
 #include <boost/atomic.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/lock_guard.hpp>
 #include <boost/lockfree/spsc_queue.hpp>
+#include <boost/chrono/chrono.hpp>
 
 #include "CSingleton.hpp"
+#include "CResultRow.hpp"
+#include "CSchemaRow.hpp"
+#include "CSlotTable.hpp"
 
 using std::string;
-using std::list;
 using std::vector;
 using std::queue;
 using std::shared_ptr;
 using boost::atomic;
 using boost::unordered_map;
+using boost::unordered_multimap;
 using boost::mutex;
 
 class CCallback;
@@ -68,10 +70,8 @@ struct Channel
 		WasPasswordToggled = false;
 	int RequiredTalkPower = 0;
 
-	list<unsigned int> Clients;
 	int MaxClients = -1;
 };
-typedef shared_ptr<Channel> Channel_t;
 
 struct Client
 {
@@ -124,24 +124,388 @@ struct Client
 
 	Channel::Id_t CurrentChannel = Channel::Invalid;
 };
-typedef shared_ptr<Client> Client_t;
+
+
+//the columns are indexed by slot (see CSlotTable::Find) and only valid for
+//used slots; strings are immutable and shared between the cache and its
+//snapshots, so copying a table doesn't copy them
+typedef shared_ptr<const string> SharedString_t;
+
+struct ChannelTable : public CSlotTable<ChannelTable>
+{
+	enum Flags : unsigned char
+	{
+		HAS_PASSWORD = 1,
+		WAS_PASSWORD_TOGGLED = 2
+	};
+
+	vector<Channel::Id_t>
+		ParentId,
+		OrderId;
+	vector<Channel::Types> Type;
+	vector<unsigned char> Flag;
+	vector<int>
+		RequiredTalkPower,
+		MaxClients;
+	vector<SharedString_t> Name;
+
+
+	bool Insert(Channel::Id_t cid, const Channel &channel)
+	{
+		const Slot_t slot = InsertSlot(cid);
+		if (slot == NoSlot)
+			return false;
+
+		ParentId[slot] = channel.ParentId;
+		OrderId[slot] = channel.OrderId;
+		Type[slot] = channel.Type;
+		Flag[slot] = (channel.HasPassword ? HAS_PASSWORD : 0)
+			| (channel.WasPasswordToggled ? WAS_PASSWORD_TOGGLED : 0);
+		RequiredTalkPower[slot] = channel.RequiredTalkPower;
+		MaxClients[slot] = channel.MaxClients;
+		Name[slot] = std::make_shared<const string>(channel.Name);
+		return true;
+	}
+	inline bool Erase(Channel::Id_t cid)
+	{
+		return EraseSlot(cid);
+	}
+
+	inline bool HasFlag(Slot_t slot, Flags flag) const
+	{
+		return (Flag[slot] & flag) != 0;
+	}
+	inline void SetFlag(Slot_t slot, Flags flag, bool value)
+	{
+		Flag[slot] = value ? (Flag[slot] | flag) : (Flag[slot] & ~flag);
+	}
+	inline const string &GetName(Slot_t slot) const
+	{
+		return *Name[slot];
+	}
+	inline void SetName(Slot_t slot, const string &name)
+	{
+		Name[slot] = std::make_shared<const string>(name);
+	}
+
+	void ResizeColumns(size_t size)
+	{
+		//Invalid is passed by value, it has no out-of-class definition
+		ParentId.resize(size, Channel::Id_t(Channel::Invalid));
+		OrderId.resize(size, Channel::Id_t(Channel::Invalid));
+		Type.resize(size, Channel::Types::INVALID);
+		Flag.resize(size, 0);
+		RequiredTalkPower.resize(size, 0);
+		MaxClients.resize(size, -1);
+		Name.resize(size);
+	}
+	inline void ResetColumns(Slot_t slot)
+	{
+		Name[slot].reset();
+	}
+};
+
+struct ClientTable : public CSlotTable<ClientTable>
+{
+	vector<Channel::Id_t> CurrentChannel;
+	vector<Client::Id_t> DatabaseId;
+	vector<SharedString_t>
+		Uid,
+		IpAddress;
+
+
+	bool Insert(Client::Id_t clid, const Client &client)
+	{
+		const Slot_t slot = InsertSlot(clid);
+		if (slot == NoSlot)
+			return false;
+
+		CurrentChannel[slot] = client.CurrentChannel;
+		DatabaseId[slot] = client.DatabaseId;
+		Uid[slot] = std::make_shared<const string>(client.Uid);
+		IpAddress[slot] = std::make_shared<const string>(client.IpAddress);
+		return true;
+	}
+	inline bool Erase(Client::Id_t clid)
+	{
+		return EraseSlot(clid);
+	}
+
+	inline const string &GetUid(Slot_t slot) const
+	{
+		return *Uid[slot];
+	}
+	inline const string &GetIpAddress(Slot_t slot) const
+	{
+		return *IpAddress[slot];
+	}
+	inline void SetIpAddress(Slot_t slot, const string &ip)
+	{
+		IpAddress[slot] = std::make_shared<const string>(ip);
+	}
+
+	void ResizeColumns(size_t size)
+	{
+		CurrentChannel.resize(size, Channel::Id_t(Channel::Invalid));
+		DatabaseId.resize(size, Client::Id_t(Client::Invalid));
+		Uid.resize(size);
+		IpAddress.resize(size);
+	}
+	inline void ResetColumns(Slot_t slot)
+	{
+		Uid[slot].reset();
+		IpAddress[slot].reset();
+	}
+};
+
+
+typedef unordered_multimap<string, Channel::Id_t> ChannelNameIndex_t;
+typedef unordered_map<Channel::Id_t, vector<Channel::Id_t>> ChannelChildren_t;
+typedef unordered_multimap<string, Client::Id_t> ClientIndex_t;
+typedef unordered_map<Channel::Id_t, vector<Client::Id_t>> ChannelClients_t;
+
+//a part of the cache the snapshots share until the network thread changes it,
+//so publishing only copies the parts that changed since the previous snapshot
+template<typename T>
+class CSharedPart
+{
+private: //variables
+	T m_Value;
+	shared_ptr<const T> m_Shared; //the copy of the latest snapshot, null after a change
+
+public: //functions
+	inline const T &Get() const
+	{
+		return m_Value;
+	}
+	//has to be used for every change
+	inline T &Edit()
+	{
+		m_Shared.reset();
+		return m_Value;
+	}
+	shared_ptr<const T> Share()
+	{
+		if (m_Shared == nullptr)
+			m_Shared = std::make_shared<const T>(m_Value);
+		return m_Shared;
+	}
+};
+
+//read-only copy of the cache, published by the network thread after it changed;
+//the natives read from the latest one and never wait for the network thread
+struct CacheSnapshot
+{
+	unsigned int Version = 0;
+
+	ChannelTable Channels;
+	shared_ptr<const ChannelNameIndex_t> ChannelNameIndex;
+	shared_ptr<const ChannelChildren_t> ChannelChildren;
+	Channel::Id_t DefaultChannel = Channel::Invalid;
+
+	ClientTable Clients;
+	shared_ptr<const ClientIndex_t>
+		ClientUidIndex,
+		ClientIpIndex;
+	shared_ptr<const ChannelClients_t> ChannelClients;
+};
+typedef shared_ptr<const CacheSnapshot> CacheSnapshot_t;
+
+
+//fields of the responses and notifies CServer parses, in the order the server sends them
+#define TSC_SERVERID_FIELDS(FIELD) \
+	FIELD(server_id)
+TSC_DECLARE_SCHEMA(ServerIdResponse, TSC_SERVERID_FIELDS);
+
+#define TSC_CHANNELINFO_FIELDS(FIELD) \
+	FIELD(channel_topic) \
+	FIELD(channel_description) \
+	FIELD(channel_codec) \
+	FIELD(channel_codec_quality) \
+	FIELD(channel_forced_silence) \
+	FIELD(channel_icon_id) \
+	FIELD(channel_codec_is_unencrypted) \
+	FIELD(seconds_empty)
+TSC_DECLARE_SCHEMA(ChannelInfoResponse, TSC_CHANNELINFO_FIELDS);
+
+#define TSC_CLIENTINFO_FIELDS(FIELD) \
+	FIELD(client_idle_time) \
+	FIELD(client_version) \
+	FIELD(client_platform) \
+	FIELD(client_input_muted) \
+	FIELD(client_output_muted) \
+	FIELD(client_input_hardware) \
+	FIELD(client_output_hardware) \
+	FIELD(client_channel_group_id) \
+	FIELD(client_servergroups) \
+	FIELD(client_created) \
+	FIELD(client_lastconnected) \
+	FIELD(client_totalconnections) \
+	FIELD(client_away) \
+	FIELD(client_away_message) \
+	FIELD(client_flag_avatar) \
+	FIELD(client_talk_power) \
+	FIELD(client_talk_request) \
+	FIELD(client_talk_request_msg) \
+	FIELD(client_description) \
+	FIELD(client_is_talker) \
+	FIELD(client_is_priority_speaker) \
+	FIELD(client_is_recording) \
+	FIELD(client_is_channel_commander) \
+	FIELD(client_icon_id) \
+	FIELD(client_country) \
+	FIELD(client_nickname) \
+	FIELD(connection_client_ip)
+TSC_DECLARE_SCHEMA(ClientInfoResponse, TSC_CLIENTINFO_FIELDS);
+
+#define TSC_CHANNELLIST_FIELDS(FIELD) \
+	FIELD(cid) \
+	FIELD(pid) \
+	FIELD(channel_order) \
+	FIELD(channel_name) \
+	FIELD(channel_flag_default) \
+	FIELD(channel_flag_password) \
+	FIELD(channel_flag_permanent) \
+	FIELD(channel_flag_semi_permanent) \
+	FIELD(channel_needed_talk_power) \
+	FIELD(channel_maxclients)
+TSC_DECLARE_SCHEMA(ChannelListRow, TSC_CHANNELLIST_FIELDS);
+
+#define TSC_CLIENTLIST_FIELDS(FIELD) \
+	FIELD(clid) \
+	FIELD(cid) \
+	FIELD(client_database_id) \
+	FIELD(client_nickname) \
+	FIELD(client_type) \
+	FIELD(client_unique_identifier) \
+	FIELD(connection_client_ip)
+TSC_DECLARE_SCHEMA(ClientListRow, TSC_CLIENTLIST_FIELDS);
+
+#define TSC_CHANNELCREATED_FIELDS(FIELD) \
+	FIELD(cid) \
+	FIELD(cpid) \
+	FIELD(channel_name) \
+	FIELD(channel_order) \
+	FIELD(channel_flag_permanent) \
+	FIELD(channel_flag_semi_permanent) \
+	FIELD(channel_flag_default) \
+	FIELD(channel_flag_password) \
+	FIELD(channel_maxclients) \
+	FIELD(channel_needed_talk_power)
+TSC_DECLARE_SCHEMA(ChannelCreatedNotify, TSC_CHANNELCREATED_FIELDS);
+
+#define TSC_CHANNELEDITED_FIELDS(FIELD) \
+	FIELD(cid) \
+	FIELD(reasonid) \
+	FIELD(channel_name) \
+	FIELD(channel_order) \
+	FIELD(channel_flag_permanent) \
+	FIELD(channel_flag_semi_permanent) \
+	FIELD(channel_flag_default) \
+	FIELD(channel_flag_password) \
+	FIELD(channel_maxclients) \
+	FIELD(channel_needed_talk_power)
+TSC_DECLARE_SCHEMA(ChannelEditedNotify, TSC_CHANNELEDITED_FIELDS);
+
+//notifychanneldeleted and notifychannelpasswordchanged
+#define TSC_CHANNELID_FIELDS(FIELD) \
+	FIELD(cid)
+TSC_DECLARE_SCHEMA(ChannelIdNotify, TSC_CHANNELID_FIELDS);
+
+#define TSC_CHANNELMOVED_FIELDS(FIELD) \
+	FIELD(cid) \
+	FIELD(cpid) \
+	FIELD(order) \
+	FIELD(reasonid)
+TSC_DECLARE_SCHEMA(ChannelMovedNotify, TSC_CHANNELMOVED_FIELDS);
+
+#define TSC_CLIENTENTERVIEW_FIELDS(FIELD) \
+	FIELD(cfid) \
+	FIELD(ctid) \
+	FIELD(reasonid) \
+	FIELD(clid) \
+	FIELD(client_unique_identifier) \
+	FIELD(client_nickname) \
+	FIELD(client_database_id) \
+	FIELD(client_type)
+TSC_DECLARE_SCHEMA(ClientEnterViewNotify, TSC_CLIENTENTERVIEW_FIELDS);
+
+#define TSC_CLIENTLEFTVIEW_FIELDS(FIELD) \
+	FIELD(ctid) \
+	FIELD(reasonid) \
+	FIELD(reasonmsg) \
+	FIELD(clid)
+TSC_DECLARE_SCHEMA(ClientLeftViewNotify, TSC_CLIENTLEFTVIEW_FIELDS);
+
+#define TSC_CLIENTMOVED_FIELDS(FIELD) \
+	FIELD(ctid) \
+	FIELD(reasonid) \
+	FIELD(invokerid) \
+	FIELD(clid)
+TSC_DECLARE_SCHEMA(ClientMovedNotify, TSC_CLIENTMOVED_FIELDS);
+
+#define TSC_TEXTMESSAGE_FIELDS(FIELD) \
+	FIELD(targetmode) \
+	FIELD(msg) \
+	FIELD(target) \
+	FIELD(invokerid) \
+	FIELD(invokername)
+TSC_DECLARE_SCHEMA(TextMessageNotify, TSC_TEXTMESSAGE_FIELDS);
 
 
 class CServer : public CSingleton <CServer>
 {
 	friend class CSingleton <CServer>;
+public: //definitions
+	//the functions sending a command return its id (see CNetwork::Execute), 0 if nothing was sent
+	typedef unsigned int CommandId_t;
+	//milliseconds between two published snapshots while the cache keeps changing
+	static const unsigned int PublishInterval = 10;
+
 private: //variables
-	unordered_map<Channel::Id_t, Channel_t> m_Channels;
+	ChannelTable m_Channels;
+	CSharedPart<ChannelNameIndex_t> m_ChannelNameIndex;
+	//child channels of every parent (0 for the top level) in display order,
+	//the same order the OrderId ("channel above") chain describes
+	CSharedPart<ChannelChildren_t> m_ChannelChildren;
 	Channel::Id_t m_DefaultChannel = Channel::Invalid;
 	mutex m_ChannelMtx;
 
-	unordered_map<Client::Id_t, Client_t> m_Clients;
+	ClientTable m_Clients;
+	//the same identity or IP can be connected more than once
+	CSharedPart<ClientIndex_t>
+		m_ClientUidIndex,
+		m_ClientIpIndex;
+	//clients in every channel, unordered; kept here instead of in Channel
+	//so moving a client doesn't need m_ChannelMtx as well
+	CSharedPart<ChannelClients_t> m_ChannelClients;
 	mutex m_ClientMtx;
 
-	atomic<bool> m_IsLoggedIn;
+	//the caches above are only used by the network thread (the mutexes
+	//guard the snapshot copy), everything else reads from the snapshot;
+	//only accessed through std::atomic_load/atomic_store
+	CacheSnapshot_t m_Snapshot;
+	unsigned int m_CacheVersion = 0;
+	bool m_IsPublishPending = false;
+	boost::chrono::steady_clock::time_point m_LastPublish;
+	//expires with this instance, a delayed publish checks it before running
+	shared_ptr<const bool> m_Lifetime;
+
+	atomic<bool> m_IsLoggedIn; //logged in and the cache is filled
+	bool m_IsInitialized = false;
+	//the cache was loaded from the cache file, the first lists only correct it
+	bool m_IsWarmStart = false;
 
 	unsigned int m_ServerId = 0;
 
+	//channel- and clientlist rows received while synchronizing,
+	//only used by the network thread
+	unsigned int m_SyncRound = 0;
+	unordered_map<Channel::Id_t, Channel> m_SyncChannels;
+	Channel::Id_t m_SyncDefaultChannel = Channel::Invalid;
+	unordered_map<Client::Id_t, Client> m_SyncClients;
+	unordered_map<Client::Id_t, string> m_SyncNicknames;
+
 	boost::lockfree::spsc_queue<
 			string,
 			boost::lockfree::fixed_sized<true>,
@@ -152,64 +516,117 @@ private: //variables
 
 private: //constructor / deconstructor
 	CServer() :
+		m_Snapshot(CopySnapshot()),
+		m_Lifetime(std::make_shared<const bool>(true)),
 		m_IsLoggedIn(false)
 	{}
-	~CServer() = default;
+	~CServer();
 
 
 private: //functions (internal)
 	void Initialize();
+	//(re-)registers the notifies and (re-)fills the cache
+	void Synchronize(bool resync);
+
+	//has to be called by every change of the cache, publishes a new snapshot once the
+	//network thread is done with its current work, at most one per PublishInterval
+	void MarkCacheChanged();
+	void PublishSnapshot();
+	//copies the tables, the indexes are shared with the previous snapshot if unchanged
+	shared_ptr<CacheSnapshot> CopySnapshot();
+	inline CacheSnapshot_t GetSnapshot() const
+	{
+		return std::atomic_load(&m_Snapshot);
+	}
+	//checks the cache itself instead of the snapshot, for the network thread
+	inline bool HasChannel(Channel::Id_t cid)
+	{
+		boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
+		return m_Channels.Has(cid);
+	}
+	inline bool HasClient(Client::Id_t clid)
+	{
+		boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
+		return m_Clients.Has(clid);
+	}
+
+	//cache changes that keep the indexes up to date,
+	//these require m_ChannelMtx or m_ClientMtx to be locked
+	bool AddChannel(Channel::Id_t cid, const Channel &channel);
+	bool RemoveChannel(Channel::Id_t cid);
+	bool RenameChannel(Channel::Id_t cid, const string &name);
+	//AddChannel doesn't link the channel into the tree, so a whole channellist
+	//can be added in any order before calling RebuildChannelTree
+	void LinkChannel(Channel::Id_t cid);
+	void UnlinkChannel(Channel::Id_t cid);
+	bool MoveChannel(Channel::Id_t cid, Channel::Id_t pcid, Channel::Id_t ocid);
+	void RebuildChannelTree();
+	bool AddClient(Client::Id_t clid, const Client &client);
+	bool RemoveClient(Client::Id_t clid);
+	bool SetClientIpAddress(Client::Id_t clid, const string &ip);
+	bool SetClientChannel(Client::Id_t clid, Channel::Id_t cid);
+	void RemoveChannelClient(Channel::Id_t cid, Client::Id_t clid);
 
 
 public: //server functions
+	//fills a fresh cache from the cache file after connecting and before the login,
+	//so the natives can be used before the server sent its lists
+	bool LoadCacheFile(const string &host, unsigned short port);
 	bool Login(string login, string pass);
-	bool ChangeNickname(string nickname);
+	CommandId_t ChangeNickname(string nickname);
 	inline bool IsLoggedIn() const
 	{
 		return m_IsLoggedIn;
 	}
 
-	bool SendServerMessage(string msg);
+	CommandId_t SendServerMessage(string msg);
 
 
 public: //data query functions
-	bool QueryChannelData(Channel::Id_t cid, Channel::QueryData data, Callback_t callback);
-	bool QueryClientData(Client::Id_t clid, Client::QueryData data, Callback_t callback);
+	CommandId_t QueryChannelData(Channel::Id_t cid, Channel::QueryData data, Callback_t callback);
+	CommandId_t QueryClientData(Client::Id_t clid, Client::QueryData data, Callback_t callback);
 	bool GetQueriedData(string &dest);
 	bool GetQueriedData(int &dest);
 
 
 public: //channel functions
-	bool CreateChannel(string name, Channel::Types type = Channel::Types::TEMPORARY,
+	CommandId_t CreateChannel(string name, Channel::Types type = Channel::Types::TEMPORARY,
 		int maxusers = -1, Channel::Id_t pcid = Channel::Invalid, Channel::Id_t ocid = Channel::Invalid,
 		int talkpower = 0);
-	bool DeleteChannel(Channel::Id_t cid);
+	CommandId_t DeleteChannel(Channel::Id_t cid);
 	Channel::Id_t GetChannelIdByName(string name);
 	inline bool IsValidChannel(Channel::Id_t cid)
 	{
-		boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-		return (m_Channels.find(cid) != m_Channels.end());
+		return GetSnapshot()->Channels.Has(cid);
 	}
-	bool SetChannelName(Channel::Id_t cid, string name);
+	CommandId_t SetChannelName(Channel::Id_t cid, string name);
 	string GetChannelName(Channel::Id_t cid);
-	bool SetChannelDescription(Channel::Id_t cid, string desc);
-	bool SetChannelType(Channel::Id_t cid, Channel::Types type);
+	CommandId_t SetChannelDescription(Channel::Id_t cid, string desc);
+	CommandId_t SetChannelType(Channel::Id_t cid, Channel::Types type);
 	Channel::Types GetChannelType(Channel::Id_t cid);
-	bool SetChannelPassword(Channel::Id_t cid, string password);
+	CommandId_t SetChannelPassword(Channel::Id_t cid, string password);
 	bool HasChannelPassword(Channel::Id_t cid);
-	bool SetChannelRequiredTalkPower(Channel::Id_t cid, int talkpower);
+	CommandId_t SetChannelRequiredTalkPower(Channel::Id_t cid, int talkpower);
 	int GetChannelRequiredTalkPower(Channel::Id_t cid);
-	bool SetChannelUserLimit(Channel::Id_t cid, int maxusers);
+	CommandId_t SetChannelUserLimit(Channel::Id_t cid, int maxusers);
 	int GetChannelUserLimit(Channel::Id_t cid);
-	bool SetChannelParentId(Channel::Id_t cid, Channel::Id_t pcid);
+	CommandId_t SetChannelParentId(Channel::Id_t cid, Channel::Id_t pcid);
 	Channel::Id_t GetChannelParentId(Channel::Id_t cid);
-	bool SetChannelOrderId(Channel::Id_t cid, Channel::Id_t ocid);
+	CommandId_t SetChannelOrderId(Channel::Id_t cid, Channel::Id_t ocid);
 	Channel::Id_t GetChannelOrderId(Channel::Id_t cid);
 	inline Channel::Id_t GetDefaultChannelId()
 	{
-		boost::lock_guard<mutex> channel_mtx_guard(m_ChannelMtx);
-		return m_DefaultChannel;
+		return GetSnapshot()->DefaultChannel;
 	}
+	//all of these are in display order and return at most "max_count" ids,
+	//"cid" 0 stands for the top level
+	unsigned int GetChannelChildCount(Channel::Id_t cid);
+	vector<Channel::Id_t> GetChannelChildren(Channel::Id_t cid, size_t max_count);
+	vector<Channel::Id_t> GetChannelSiblings(Channel::Id_t cid, size_t max_count);
+	//every channel below "cid", depth-first
+	vector<Channel::Id_t> GetChannelSubtree(Channel::Id_t cid, size_t max_count);
+	unsigned int GetChannelClientCount(Channel::Id_t cid);
+	vector<Client::Id_t> GetChannelClients(Channel::Id_t cid, size_t max_count);
 
 
 public: //client functions
@@ -217,52 +634,59 @@ public: //client functions
 	Client::Id_t GetClientIdByIpAddress(string ip);
 	inline bool IsValidClient(Client::Id_t clid)
 	{
-		boost::lock_guard<mutex> client_mtx_guard(m_ClientMtx);
-		return (m_Clients.find(clid) != m_Clients.end());
+		return GetSnapshot()->Clients.Has(clid);
 	}
 	string GetClientUid(Client::Id_t clid);
 	Client::Id_t GetClientDatabaseId(Client::Id_t clid);
 	Channel::Id_t GetClientChannelId(Client::Id_t clid);
 	string GetClientIpAddress(Client::Id_t clid);
 
-	bool KickClient(Client::Id_t clid, Client::KickTypes type, string reasonmsg);
-	bool BanClient(string uid, int seconds, string reasonmsg);
-	bool MoveClient(Client::Id_t clid, Channel::Id_t cid);
+	CommandId_t KickClient(Client::Id_t clid, Client::KickTypes type, string reasonmsg);
+	CommandId_t BanClient(string uid, int seconds, string reasonmsg);
+	CommandId_t MoveClient(Client::Id_t clid, Channel::Id_t cid);
 
-	bool SetClientChannelGroup(Client::Id_t clid, int groupid, Channel::Id_t cid);
-	bool AddClientToServerGroup(Client::Id_t clid, int groupid);
-	bool RemoveClientFromServerGroup(Client::Id_t clid, int groupid);
-	bool SetClientTalkerStatus(Client::Id_t clid, bool status);
-	bool SetClientDescription(Client::Id_t clid, string desc);
+	CommandId_t SetClientChannelGroup(Client::Id_t clid, int groupid, Channel::Id_t cid);
+	CommandId_t AddClientToServerGroup(Client::Id_t clid, int groupid);
+	CommandId_t RemoveClientFromServerGroup(Client::Id_t clid, int groupid);
+	CommandId_t SetClientTalkerStatus(Client::Id_t clid, bool status);
+	CommandId_t SetClientDescription(Client::Id_t clid, string desc);
 
-	bool PokeClient(Client::Id_t clid, string msg);
-	bool SendClientMessage(Client::Id_t clid, string msg);
+	CommandId_t PokeClient(Client::Id_t clid, string msg);
+	CommandId_t SendClientMessage(Client::Id_t clid, string msg);
 
 
 public: //network callbacks
-	void OnLogin(vector<string> &res);
-	void OnChannelList(vector<string> &res);
-	void OnClientList(vector<string> &res);
+	void OnLogin(vector<boost::string_ref> &res);
+	//"resync" diffs the result against the cache (after a reconnect)
+	//and only fires callbacks for what changed meanwhile
+	void OnChannelListRow(boost::string_ref row);
+	void OnChannelList(bool resync = false);
+	void OnClientListRow(boost::string_ref row, bool resync = false);
+	void OnClientList(bool resync = false);
 
 public: //event callbacks
-	void OnChannelCreated(boost::smatch &result);
-	void OnChannelDeleted(boost::smatch &result);
-	void OnChannelReorder(boost::smatch &result);
-	void OnChannelMoved(boost::smatch &result);
-	void OnChannelRenamed(boost::smatch &result);
-	void OnChannelPasswordToggled(boost::smatch &result);
-	void OnChannelPasswordChanged(boost::smatch &result);
-	void OnChannelTypeChanged(boost::smatch &result);
-	void OnChannelSetDefault(boost::smatch &result);
-	void OnChannelMaxClientsChanged(boost::smatch &result);
-	void OnChannelRequiredTalkPowerChanged(boost::smatch &result);
-
-
-	void OnClientConnect(boost::smatch &result);
-	void OnClientDisconnect(boost::smatch &result);
-	void OnClientMoved(boost::smatch &result);
-	void OnClientServerText(boost::smatch &result);
-	void OnClientPrivateText(boost::smatch &result);
+	void OnChannelCreated(const CResultRow &row);
+	void OnChannelDeleted(const CResultRow &row);
+	//dispatches to the handlers below for every property in the notify
+	void OnChannelEdited(const CResultRow &row);
+	void OnChannelReorder(const CSchemaRow<ChannelEditedNotify> &fields);
+	void OnChannelMoved(const CResultRow &row);
+	void OnChannelRenamed(const CSchemaRow<ChannelEditedNotify> &fields);
+	void OnChannelPasswordToggled(const CSchemaRow<ChannelEditedNotify> &fields);
+	void OnChannelPasswordChanged(const CResultRow &row);
+	void OnChannelTypeChanged(const CSchemaRow<ChannelEditedNotify> &fields);
+	void OnChannelSetDefault(const CSchemaRow<ChannelEditedNotify> &fields);
+	void OnChannelMaxClientsChanged(const CSchemaRow<ChannelEditedNotify> &fields);
+	void OnChannelRequiredTalkPowerChanged(const CSchemaRow<ChannelEditedNotify> &fields);
+
+
+	void OnClientConnect(const CResultRow &row);
+	void OnClientDisconnect(const CResultRow &row);
+	void OnClientMoved(const CResultRow &row);
+	//dispatches on "targetmode" to the handlers below
+	void OnTextMessage(const CResultRow &row);
+	void OnClientServerText(const CSchemaRow<TextMessageNotify> &fields);
+	void OnClientPrivateText(const CSchemaRow<TextMessageNotify> &fields);
 };
 
 
@@ -0,0 +1,204 @@
+#pragma once
+#ifndef INC_CSLOTTABLE_H
+#define INC_CSLOTTABLE_H
+
+
+#include <vector>
+
+using std::vector;
+
+
+//entities stored in dense slots, "Derived" stores the fields column-wise, indexed
+//by slot, and provides ResizeColumns(size_t) and ResetColumns(Slot_t);
+//ids are mapped to slots through a flat hash table, so any id can be stored and the
+//columns only grow with the number of entities; copying a table (e.g. for a
+//snapshot) copies a few flat arrays
+//every entity gets a generation no other entity of the table had before,
+//so a reused id can be told apart from its previous owner
+template<typename Derived>
+class CSlotTable
+{
+public: //definitions
+	typedef unsigned int Id_t;
+	typedef unsigned int Slot_t;
+	typedef unsigned int Generation_t;
+
+	static const Slot_t NoSlot = static_cast<Slot_t>(-1);
+
+private: //definitions
+	struct IndexEntry
+	{
+		Id_t Id;
+		Slot_t Slot; //NoSlot if the entry is empty
+	};
+
+private: //variables
+	//open addressing with linear probing; the size is 0 or a power
+	//of two and it's at most half full
+	vector<IndexEntry> m_Index;
+	unsigned int m_IndexShift = 32;
+
+	vector<Id_t> m_SlotIds;
+	vector<Generation_t> m_Generations; //0 while the slot is free
+	vector<Slot_t> m_FreeSlots;
+	Generation_t m_LastGeneration = 0;
+	size_t m_Count = 0;
+
+
+public: //functions
+	inline Slot_t Find(Id_t id) const
+	{
+		if (m_Index.empty())
+			return NoSlot;
+
+		const size_t mask = m_Index.size() - 1;
+		for (size_t i = GetHomePos(id); ; i = (i + 1) & mask)
+		{
+			const IndexEntry &entry = m_Index[i];
+			if (entry.Slot == NoSlot)
+				return NoSlot;
+			if (entry.Id == id)
+				return entry.Slot;
+		}
+	}
+	//NoSlot if the entity with this id isn't the one of "generation" anymore
+	inline Slot_t Find(Id_t id, Generation_t generation) const
+	{
+		const Slot_t slot = Find(id);
+		return slot != NoSlot && m_Generations[slot] == generation ? slot : NoSlot;
+	}
+	inline bool Has(Id_t id) const
+	{
+		return Find(id) != NoSlot;
+	}
+	//0 if there's no entity with this id
+	inline Generation_t GetGeneration(Id_t id) const
+	{
+		const Slot_t slot = Find(id);
+		return slot != NoSlot ? m_Generations[slot] : 0;
+	}
+	inline size_t GetCount() const
+	{
+		return m_Count;
+	}
+
+	//calls "func" with the id and slot of every entity, in no particular order
+	template<typename F>
+	void ForEach(F &&func) const
+	{
+		const Slot_t size = static_cast<Slot_t>(m_SlotIds.size());
+		for (Slot_t slot = 0; slot != size; ++slot)
+		{
+			if (m_Generations[slot] != 0)
+				func(m_SlotIds[slot], slot);
+		}
+	}
+
+protected: //functions
+	//returns NoSlot if the id is already used,
+	//the columns of the returned slot have to be set afterwards
+	Slot_t InsertSlot(Id_t id)
+	{
+		if (Has(id))
+			return NoSlot;
+
+		if ((m_Count + 1) * 2 > m_Index.size())
+			Rehash(m_Index.empty() ? 16 : m_Index.size() * 2);
+
+		Slot_t slot;
+		if (m_FreeSlots.empty() == false)
+		{
+			slot = m_FreeSlots.back();
+			m_FreeSlots.pop_back();
+		}
+		else
+		{
+			slot = static_cast<Slot_t>(m_SlotIds.size());
+			m_SlotIds.push_back(id);
+			m_Generations.push_back(0);
+			static_cast<Derived *>(this)->ResizeColumns(m_SlotIds.size());
+		}
+
+		m_SlotIds[slot] = id;
+		if (++m_LastGeneration == 0)
+			++m_LastGeneration;
+		m_Generations[slot] = m_LastGeneration;
+		PlaceInIndex(id, slot);
+		++m_Count;
+		return slot;
+	}
+	bool EraseSlot(Id_t id)
+	{
+		if (m_Index.empty())
+			return false;
+
+		const size_t mask = m_Index.size() - 1;
+		size_t pos = GetHomePos(id);
+		while (m_Index[pos].Slot != NoSlot && m_Index[pos].Id != id)
+			pos = (pos + 1) & mask;
+		if (m_Index[pos].Slot == NoSlot)
+			return false;
+
+		const Slot_t slot = m_Index[pos].Slot;
+		m_Generations[slot] = 0;
+		static_cast<Derived *>(this)->ResetColumns(slot);
+		m_FreeSlots.push_back(slot);
+		--m_Count;
+
+		//entries further down the probe sequence move up into the gap,
+		//unless that would put them in front of their home position
+		for (size_t next = (pos + 1) & mask; m_Index[next].Slot != NoSlot; next = (next + 1) & mask)
+		{
+			const size_t home = GetHomePos(m_Index[next].Id);
+			const bool stays = pos <= next
+				? (pos < home && home <= next)
+				: (pos < home || home <= next);
+			if (stays == false)
+			{
+				m_Index[pos] = m_Index[next];
+				pos = next;
+			}
+		}
+		m_Index[pos].Slot = NoSlot;
+		return true;
+	}
+
+private: //functions
+	inline size_t GetHomePos(Id_t id) const
+	{
+		//fibonacci hashing, spreads ids with a common stride as well
+		return static_cast<size_t>(static_cast<unsigned int>(id * 2654435769u) >> m_IndexShift);
+	}
+	void PlaceInIndex(Id_t id, Slot_t slot)
+	{
+		const size_t mask = m_Index.size() - 1;
+		size_t pos = GetHomePos(id);
+		while (m_Index[pos].Slot != NoSlot)
+			pos = (pos + 1) & mask;
+		m_Index[pos].Id = id;
+		m_Index[pos].Slot = slot;
+	}
+	void Rehash(size_t size)
+	{
+		IndexEntry empty_entry;
+		empty_entry.Id = 0;
+		empty_entry.Slot = NoSlot;
+		m_Index.assign(size, empty_entry);
+
+		unsigned int bits = 0;
+		while ((static_cast<size_t>(1) << bits) < size)
+			++bits;
+		m_IndexShift = 32 - bits;
+
+		const Slot_t num_slots = static_cast<Slot_t>(m_SlotIds.size());
+		for (Slot_t slot = 0; slot != num_slots; ++slot)
+		{
+			if (m_Generations[slot] != 0)
+				PlaceInIndex(m_SlotIds[slot], slot);
+		}
+	}
+
+};
+
+
+#endif // INC_CSLOTTABLE_H
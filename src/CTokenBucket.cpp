@@ -0,0 +1,98 @@
+#include "CTokenBucket.hpp"
+
+#include <algorithm>
+#include <boost/thread/lock_guard.hpp>
+
+
+void CTokenBucket::Configure(unsigned int commands, unsigned int seconds)
+{
+	boost::lock_guard<boost::mutex> lock_guard(m_Mutex);
+
+	if (commands == 0 || seconds == 0)
+	{
+		m_Burst = m_Rate = m_Tokens = 0.0;
+		return;
+	}
+
+	m_Burst = static_cast<double>(commands);
+	m_Rate = m_Burst / static_cast<double>(seconds);
+	m_Tokens = m_Burst;
+	m_LastRefill = Clock_t::now();
+}
+
+bool CTokenBucket::TryConsume(Clock_t::duration &wait)
+{
+	boost::lock_guard<boost::mutex> lock_guard(m_Mutex);
+
+	const Clock_t::time_point now = Clock_t::now();
+	if (now < m_BlockedUntil)
+	{
+		wait = m_BlockedUntil - now;
+		return false;
+	}
+
+	if (m_Rate == 0.0)
+		return true;
+
+	Refill(now);
+	if (m_Tokens >= 1.0)
+	{
+		m_Tokens -= 1.0;
+		return true;
+	}
+
+	wait = boost::chrono::duration_cast<Clock_t::duration>(
+		boost::chrono::duration<double>((1.0 - m_Tokens) / m_Rate));
+	return false;
+}
+
+void CTokenBucket::OnFloodError(unsigned int wait_seconds)
+{
+	//don't go below one command every five seconds
+	static const double min_rate = 0.2;
+
+	boost::lock_guard<boost::mutex> lock_guard(m_Mutex);
+
+	const Clock_t::time_point now = Clock_t::now();
+	if (m_Rate == 0.0)
+	{
+		m_Burst = static_cast<double>(DefaultFloodCommands);
+		m_Rate = m_Burst / static_cast<double>(DefaultFloodTime);
+	}
+	else
+	{
+		m_Rate = std::max(m_Rate * 0.75, min_rate);
+	}
+
+	m_Tokens = 0.0;
+	m_LastRefill = now;
+	m_BlockedUntil = std::max(m_BlockedUntil, now + boost::chrono::seconds(wait_seconds));
+	m_FloodErrors++;
+}
+
+CTokenBucket::State CTokenBucket::GetState()
+{
+	boost::lock_guard<boost::mutex> lock_guard(m_Mutex);
+
+	const Clock_t::time_point now = Clock_t::now();
+	if (m_Rate != 0.0)
+		Refill(now);
+
+	State state;
+	state.Tokens = static_cast<unsigned int>(m_Tokens);
+	state.Burst = static_cast<unsigned int>(m_Burst);
+	state.TokenIntervalMs = m_Rate != 0.0 ? static_cast<unsigned int>(1000.0 / m_Rate) : 0;
+	state.FloodErrors = m_FloodErrors;
+	state.IsBlocked = now < m_BlockedUntil;
+	return state;
+}
+
+void CTokenBucket::Refill(Clock_t::time_point now)
+{
+	if (now <= m_LastRefill)
+		return;
+
+	const double elapsed = boost::chrono::duration<double>(now - m_LastRefill).count();
+	m_Tokens = std::min(m_Burst, m_Tokens + elapsed * m_Rate);
+	m_LastRefill = now;
+}
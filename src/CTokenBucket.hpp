@@ -0,0 +1,70 @@
+#pragma once
+#ifndef INC_CTOKENBUCKET_H
+#define INC_CTOKENBUCKET_H
+
+
+#include <boost/thread/mutex.hpp>
+#include <boost/chrono/chrono.hpp>
+
+
+//paces outgoing commands so the server's query flood protection
+//("query_flood_commands" per "query_flood_time" seconds) doesn't kick in
+class CTokenBucket
+{
+public: //definitions
+	typedef boost::chrono::steady_clock Clock_t;
+
+	struct State
+	{
+		unsigned int
+			Tokens = 0,
+			Burst = 0,
+			TokenIntervalMs = 0, //0 if unlimited
+			FloodErrors = 0;
+		bool IsBlocked = false;
+	};
+
+	//TeamSpeak3 server defaults, used once the server complains about flooding
+	static const unsigned int DefaultFloodCommands = 10;
+	static const unsigned int DefaultFloodTime = 3;
+
+private: //variables
+	boost::mutex m_Mutex;
+
+	double
+		m_Tokens = 0.0,
+		m_Burst = 0.0,
+		m_Rate = 0.0; //tokens per second, 0 means unlimited
+	Clock_t::time_point
+		m_LastRefill,
+		m_BlockedUntil;
+	unsigned int m_FloodErrors = 0;
+
+
+public: //constructor / deconstructor
+	CTokenBucket() = default;
+	~CTokenBucket() = default;
+	CTokenBucket(const CTokenBucket &rhs) = delete;
+
+
+public: //functions
+	//allows "commands" commands every "seconds" seconds, 0 commands disables pacing
+	void Configure(unsigned int commands, unsigned int seconds);
+
+	//takes a token if one is available, otherwise
+	//"wait" is set to the time until the next one is
+	bool TryConsume(Clock_t::duration &wait);
+
+	//the server rejected a command for flooding and wants us to pause;
+	//learns a slower rate from it
+	void OnFloodError(unsigned int wait_seconds);
+
+	State GetState();
+
+private: //functions
+	void Refill(Clock_t::time_point now); //m_Mutex has to be locked
+
+};
+
+
+#endif // INC_CTOKENBUCKET_H
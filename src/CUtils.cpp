@@ -1,42 +1,10 @@
 #include "CUtils.hpp"
 
+#include <cstring>
 #include <boost/spirit/include/qi.hpp>
 #include <boost/spirit/include/karma.hpp>
 
 
-bool CUtils::ParseField(const string &row, const string &field, string &dest)
-{
-	size_t field_pos = row.find(field);
-	if (field_pos != string::npos)
-	{
-		//field can exist in row without a result
-		//that's why we have to check if there is an equal sign
-		size_t equal_sign_pos = field_pos + field.length();
-		if (equal_sign_pos < row.length() && row.at(equal_sign_pos) == '=')
-		{
-			const size_t data_pos = field_pos + field.length() + 1;
-			dest = row.substr(data_pos, row.find_first_of(" \n\r", field_pos) - data_pos);
-			return true;
-		}
-	}
-	return false;
-}
-
-bool CUtils::ParseField(const string &row, const string &field, int &dest)
-{
-	string buffer;
-	return  ParseField(row, field, buffer)
-			&& boost::spirit::qi::parse(buffer.begin(), buffer.end(), boost::spirit::qi::int_, dest);
-}
-
-bool CUtils::ParseField(const string &row, const string &field, unsigned int &dest)
-{
-	string buffer;
-	return  ParseField(row, field, buffer)
-		&& boost::spirit::qi::parse(buffer.begin(), buffer.end(), boost::spirit::qi::uint_, dest);
-}
-
-
 bool CUtils::ConvertStringToInt(const string &input, int &output)
 {
 	return boost::spirit::qi::parse(input.begin(), input.end(), boost::spirit::qi::int_, output);
@@ -70,34 +38,113 @@ static const char CharEscapeTable[][2][5] =
 	{ "", "\xc3\x9c" }*/
 };
 
+//char -> char following the backslash in its escape sequence, 0 if it isn't escaped
+static const struct EscapeTable
+{
+	char Chars[256];
+	EscapeTable() : Chars()
+	{
+		for (auto &e : CharEscapeTable)
+			Chars[static_cast<unsigned char>(e[0][0])] = e[1][1];
+	}
+} escape_table;
+
 void CUtils::EscapeString(string &str)
 {
-	if (str.length())
+	const size_t length = str.length();
+	size_t num_escapes = 0;
+	for (char c : str)
+		num_escapes += escape_table.Chars[static_cast<unsigned char>(c)] != 0;
+
+	if (num_escapes == 0)
+		return;
+
+	//every escaped char takes one more byte, fill from the back in place
+	str.resize(length + num_escapes);
+	char *data = &str[0];
+	size_t write_pos = length + num_escapes;
+	for (size_t read_pos = length; read_pos-- != 0; )
 	{
-		for (size_t i = 0; i < str.length(); ++i)
+		const char c = data[read_pos];
+		const char escaped = escape_table.Chars[static_cast<unsigned char>(c)];
+		if (escaped != 0)
 		{
-			const char char_val = str.at(i);
-			for (size_t ci = 0; ci < (sizeof(CharEscapeTable) / sizeof(CharEscapeTable[0])); ++ci)
-			{
-				if (CharEscapeTable[ci][0][0] == char_val)
-				{
-					str.replace(i++, 1, CharEscapeTable[ci][1], 2);
-					break;
-				}
-			}
+			data[--write_pos] = escaped;
+			data[--write_pos] = '\\';
 		}
+		else
+			data[--write_pos] = c;
+	}
+}
+
+void format(fmt::BasicWriter<char> &writer, const fmt::FormatSpec &spec, const Escaped &value)
+{
+	const char
+		*run_start = value.Str.data(),
+		*end = value.Str.data() + value.Str.length();
+	for (const char *i = run_start; i != end; ++i)
+	{
+		const char escaped = escape_table.Chars[static_cast<unsigned char>(*i)];
+		if (escaped == 0)
+			continue;
+
+		//everything up to here doesn't need escaping
+		if (i != run_start)
+			writer << fmt::StringRef(run_start, i - run_start);
+
+		const char sequence[2] = { '\\', escaped };
+		writer << fmt::StringRef(sequence, 2);
+		run_start = i + 1;
 	}
+	if (run_start != end)
+		writer << fmt::StringRef(run_start, end - run_start);
 }
 
 void CUtils::UnEscapeString(string &str)
 {
-	if (str.length() >= 2)
+	//escape char -> original char, 0 for unknown escape sequences
+	static const struct UnEscapeTable
 	{
-		for (size_t ci = 0; ci < (sizeof(CharEscapeTable) / sizeof(CharEscapeTable[0])); ++ci)
+		char Chars[256];
+		UnEscapeTable() : Chars()
 		{
-			size_t find_pos = 0;
-			while ((find_pos = str.find(CharEscapeTable[ci][1])) != string::npos)
-				str.replace(find_pos, 2, CharEscapeTable[ci][0]);
+			for (auto &e : CharEscapeTable)
+				Chars[static_cast<unsigned char>(e[1][1])] = e[0][0];
 		}
+	} unescape_table;
+
+
+	//most strings don't contain anything escaped at all
+	const size_t length = str.length();
+	const char *first_escape = static_cast<const char *>(std::memchr(str.data(), '\\', length));
+	if (first_escape == nullptr)
+		return;
+
+	//decode in place in a single pass, the result is never longer
+	char *data = &str[0];
+	size_t
+		read_pos = first_escape - data,
+		write_pos = read_pos;
+	while (read_pos < length)
+	{
+		if (data[read_pos] == '\\' && read_pos + 1 < length)
+		{
+			const char unescaped = unescape_table.Chars[static_cast<unsigned char>(data[read_pos + 1])];
+			if (unescaped != 0)
+			{
+				data[write_pos++] = unescaped;
+				read_pos += 2;
+				continue;
+			}
+		}
+
+		//copy everything up to the next backslash in one go
+		const char *next_escape = static_cast<const char *>(
+			std::memchr(data + read_pos + 1, '\\', length - read_pos - 1));
+		const size_t chunk_end = next_escape != nullptr ? next_escape - data : length;
+		std::memmove(data + write_pos, data + read_pos, chunk_end - read_pos);
+		write_pos += chunk_end - read_pos;
+		read_pos = chunk_end;
 	}
+	str.resize(write_pos);
 }
@@ -3,12 +3,27 @@
 
 
 #include <string>
+#include <boost/utility/string_ref.hpp>
 
 #include "CSingleton.hpp"
+#include "format.h"
 
 using std::string;
 
 
+//escapes the string while it is formatted into a command,
+//without any intermediate string: fmt::format("... msg={}", Escaped(msg))
+struct Escaped
+{
+	explicit Escaped(boost::string_ref str) :
+		Str(str)
+	{ }
+
+	boost::string_ref Str;
+};
+void format(fmt::BasicWriter<char> &writer, const fmt::FormatSpec &spec, const Escaped &value);
+
+
 class CUtils : public CSingleton <CUtils>
 {
 	friend class CSingleton <CUtils>;
@@ -18,10 +33,6 @@ private: //constructor / deconstructor
 
 
 public: //functions
-	bool ParseField(const string &row, const string &field, string &dest);
-	bool ParseField(const string &row, const string &field, int &dest);
-	bool ParseField(const string &row, const string &field, unsigned int &dest);
-
 	bool ConvertStringToInt(const string &input, int &output);
 	bool ConvertStringToInt(const string &input, unsigned int &output);
 
@@ -2,6 +2,7 @@
 #include "natives.hpp"
 #include "CNetwork.hpp"
 #include "CServer.hpp"
+#include "CCacheFile.hpp"
 #include "CCallback.hpp"
 #include "version.hpp"
 
@@ -33,6 +34,7 @@ PLUGIN_EXPORT void PLUGIN_CALL Unload()
 {
 	CNetwork::CSingleton::Destroy();
 	CServer::CSingleton::Destroy();
+	CCacheFile::CSingleton::Destroy();
 
 	logprintf("plugin.TSConnector: Plugin unloaded.");
 }
@@ -42,8 +44,15 @@ extern "C" const AMX_NATIVE_INFO native_list[] =
 {
 	AMX_DEFINE_NATIVE(TSC_Connect)
 	AMX_DEFINE_NATIVE(TSC_Disconnect)
+	AMX_DEFINE_NATIVE(TSC_SetCacheFile)
 	AMX_DEFINE_NATIVE(TSC_ChangeNickname)
 	AMX_DEFINE_NATIVE(TSC_SendServerMessage)
+	AMX_DEFINE_NATIVE(TSC_SetPipelineDepth)
+	AMX_DEFINE_NATIVE(TSC_GetQueueWaitStats)
+	AMX_DEFINE_NATIVE(TSC_SetFloodControl)
+	AMX_DEFINE_NATIVE(TSC_GetFloodControlState)
+	AMX_DEFINE_NATIVE(TSC_SetCommandTimeout)
+	AMX_DEFINE_NATIVE(TSC_Cancel)
 
 
 	AMX_DEFINE_NATIVE(TSC_QueryChannelData)
@@ -71,6 +80,12 @@ extern "C" const AMX_NATIVE_INFO native_list[] =
 	AMX_DEFINE_NATIVE(TSC_SetChannelOrderId)
 	AMX_DEFINE_NATIVE(TSC_GetChannelOrderId)
 	AMX_DEFINE_NATIVE(TSC_GetDefaultChannelId)
+	AMX_DEFINE_NATIVE(TSC_GetChannelChildCount)
+	AMX_DEFINE_NATIVE(TSC_GetChannelChildren)
+	AMX_DEFINE_NATIVE(TSC_GetChannelSiblings)
+	AMX_DEFINE_NATIVE(TSC_GetChannelSubtree)
+	AMX_DEFINE_NATIVE(TSC_GetChannelClientCount)
+	AMX_DEFINE_NATIVE(TSC_GetChannelClients)
 
 
 	AMX_DEFINE_NATIVE(TSC_GetClientIdByUid)
@@ -3,10 +3,11 @@
 
 #include "CNetwork.hpp"
 #include "CServer.hpp"
+#include "CCacheFile.hpp"
 #include "CCallback.hpp"
 
 
-//native TSC_Connect(user[], pass[], host[], port = 9987, serverquery_port = 10011);
+//native TSC_Connect(user[], pass[], host[], port = 9987, serverquery_port = 10011, query_sessions = 1);
 AMX_DECLARE_NATIVE(Native::TSC_Connect)
 {
 	//(sadly) neccessary
@@ -23,35 +24,26 @@ AMX_DECLARE_NATIVE(Native::TSC_Connect)
 		server_port = static_cast<unsigned short>(params[4]),
 		query_port = static_cast<unsigned short>(params[5]);
 
+	//scripts compiled with an older include don't pass the session count
+	cell session_count = 1;
+	if (static_cast<cell>(params[0] / sizeof(cell)) >= 6)
+		session_count = params[6];
+
 
 	if (login.empty() || pass.empty() || host.empty()
-		|| server_port == 0 || query_port == 0)
+		|| server_port == 0 || query_port == 0 || session_count < 1)
 		return 0;
 
 
-	if (CNetwork::Get()->Connect(host, server_port, query_port))
+	//TSC_OnConnect is called once we're logged in and the cache is filled,
+	//TSC_OnConnectFailed if that didn't work out
+	if (CNetwork::Get()->Connect(host, server_port, query_port,
+		static_cast<unsigned int>(session_count)))
 	{
-		auto timeout_start = boost::chrono::steady_clock::now();
-		while (CNetwork::Get()->IsConnected() == false)
-		{
-			if ((boost::chrono::steady_clock::now() - timeout_start) < boost::chrono::seconds(3))
-				boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
-			else
-				return 0;
-		}
-
-		timeout_start = boost::chrono::steady_clock::now();
-		if (CServer::Get()->Login(login, pass))
-		{
-			while (CServer::Get()->IsLoggedIn() == false)
-			{
-				if ((boost::chrono::steady_clock::now() - timeout_start) < boost::chrono::seconds(3))
-					boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
-				else
-					return 0;
-			}
-			return 1;
-		}
+		//the natives can read a cache saved by an earlier run until the lists arrived;
+		//loaded before the login is queued, so the network thread sees it when logged in
+		CServer::Get()->LoadCacheFile(host, server_port);
+		return CServer::Get()->Login(login, pass) ? 1 : 0;
 	}
 	return 0;
 }
@@ -64,6 +56,17 @@ AMX_DECLARE_NATIVE(Native::TSC_Disconnect)
 	return true;
 }
 
+//native TSC_SetCacheFile(const filename[], save_interval = 60);
+AMX_DECLARE_NATIVE(Native::TSC_SetCacheFile)
+{
+	if (params[2] < 0)
+		return 0;
+
+	CCacheFile::Get()->SetPath(amx_GetCppString(amx, params[1]),
+		static_cast<unsigned int>(params[2]));
+	return 1;
+}
+
 //native TSC_ChangeNickname(nickname[]);
 AMX_DECLARE_NATIVE(Native::TSC_ChangeNickname)
 {
@@ -78,6 +81,83 @@ AMX_DECLARE_NATIVE(Native::TSC_SendServerMessage)
 		amx_GetCppString(amx, params[1]));
 }
 
+//native TSC_SetPipelineDepth(depth);
+AMX_DECLARE_NATIVE(Native::TSC_SetPipelineDepth)
+{
+	if (params[1] < 1)
+		return 0;
+
+	return CNetwork::Get()->SetPipelineDepth(
+		static_cast<unsigned int>(params[1]));
+}
+
+//native TSC_GetQueueWaitStats(TSC_COMMAND_PRIORITY:priority, &commands, &avg_wait_us, &max_wait_us);
+AMX_DECLARE_NATIVE(Native::TSC_GetQueueWaitStats)
+{
+	if (params[1] < 0 || params[1] > static_cast<cell>(ECommandPriority::BACKGROUND))
+		return 0;
+
+	CNetwork::QueueWaitStats stats = CNetwork::Get()->GetQueueWaitStats(
+		static_cast<ECommandPriority>(params[1]));
+
+	cell *dest = nullptr;
+	amx_GetAddr(amx, params[2], &dest);
+	*dest = static_cast<cell>(stats.Commands);
+	amx_GetAddr(amx, params[3], &dest);
+	*dest = static_cast<cell>(stats.Commands != 0 ? stats.TotalWaitUs / stats.Commands : 0);
+	amx_GetAddr(amx, params[4], &dest);
+	*dest = static_cast<cell>(stats.MaxWaitUs);
+	return 1;
+}
+
+//native TSC_SetFloodControl(commands, seconds);
+AMX_DECLARE_NATIVE(Native::TSC_SetFloodControl)
+{
+	if (params[1] < 0 || params[2] < 0)
+		return 0;
+
+	CNetwork::Get()->GetFloodControl().Configure(
+		static_cast<unsigned int>(params[1]),
+		static_cast<unsigned int>(params[2]));
+	return 1;
+}
+
+//native TSC_GetFloodControlState(&tokens, &burst, &token_interval_ms, &flood_errors, &bool:is_paused);
+AMX_DECLARE_NATIVE(Native::TSC_GetFloodControlState)
+{
+	CTokenBucket::State state = CNetwork::Get()->GetFloodControl().GetState();
+
+	cell *dest = nullptr;
+	amx_GetAddr(amx, params[1], &dest);
+	*dest = static_cast<cell>(state.Tokens);
+	amx_GetAddr(amx, params[2], &dest);
+	*dest = static_cast<cell>(state.Burst);
+	amx_GetAddr(amx, params[3], &dest);
+	*dest = static_cast<cell>(state.TokenIntervalMs);
+	amx_GetAddr(amx, params[4], &dest);
+	*dest = static_cast<cell>(state.FloodErrors);
+	amx_GetAddr(amx, params[5], &dest);
+	*dest = state.IsBlocked ? 1 : 0;
+	return 1;
+}
+
+//native TSC_SetCommandTimeout(milliseconds);
+AMX_DECLARE_NATIVE(Native::TSC_SetCommandTimeout)
+{
+	if (params[1] < 0)
+		return 0;
+
+	CNetwork::Get()->SetCommandTimeout(static_cast<unsigned int>(params[1]));
+	return 1;
+}
+
+//native TSC_Cancel(commandid);
+AMX_DECLARE_NATIVE(Native::TSC_Cancel)
+{
+	return CNetwork::Get()->Cancel(
+		static_cast<CNetwork::CommandId_t>(params[1])) ? 1 : 0;
+}
+
 
 
 //native TSC_QueryChannelData(channelid, TSC_CHANNEL_QUERYDATA:data, const callback[], const format[] = "", ...);
@@ -290,6 +370,70 @@ AMX_DECLARE_NATIVE(Native::TSC_GetDefaultChannelId)
 	return CServer::Get()->GetDefaultChannelId();
 }
 
+//copies the ids into the Pawn array, returns the number of ids copied
+static cell SetAmxIdArray(AMX *amx, cell array_addr, const vector<unsigned int> &ids)
+{
+	cell *dest = nullptr;
+	amx_GetAddr(amx, array_addr, &dest);
+	for (size_t i = 0; i != ids.size(); ++i)
+		dest[i] = static_cast<cell>(ids[i]);
+	return static_cast<cell>(ids.size());
+}
+
+//native TSC_GetChannelChildCount(channelid);
+AMX_DECLARE_NATIVE(Native::TSC_GetChannelChildCount)
+{
+	return CServer::Get()->GetChannelChildCount(
+		static_cast<Channel::Id_t>(params[1]));
+}
+
+//native TSC_GetChannelChildren(channelid, dest[], maxlen = sizeof(dest));
+AMX_DECLARE_NATIVE(Native::TSC_GetChannelChildren)
+{
+	if (params[3] <= 0)
+		return 0;
+
+	return SetAmxIdArray(amx, params[2], CServer::Get()->GetChannelChildren(
+		static_cast<Channel::Id_t>(params[1]), static_cast<size_t>(params[3])));
+}
+
+//native TSC_GetChannelSiblings(channelid, dest[], maxlen = sizeof(dest));
+AMX_DECLARE_NATIVE(Native::TSC_GetChannelSiblings)
+{
+	if (params[3] <= 0)
+		return 0;
+
+	return SetAmxIdArray(amx, params[2], CServer::Get()->GetChannelSiblings(
+		static_cast<Channel::Id_t>(params[1]), static_cast<size_t>(params[3])));
+}
+
+//native TSC_GetChannelSubtree(channelid, dest[], maxlen = sizeof(dest));
+AMX_DECLARE_NATIVE(Native::TSC_GetChannelSubtree)
+{
+	if (params[3] <= 0)
+		return 0;
+
+	return SetAmxIdArray(amx, params[2], CServer::Get()->GetChannelSubtree(
+		static_cast<Channel::Id_t>(params[1]), static_cast<size_t>(params[3])));
+}
+
+//native TSC_GetChannelClientCount(channelid);
+AMX_DECLARE_NATIVE(Native::TSC_GetChannelClientCount)
+{
+	return CServer::Get()->GetChannelClientCount(
+		static_cast<Channel::Id_t>(params[1]));
+}
+
+//native TSC_GetChannelClients(channelid, dest[], maxlen = sizeof(dest));
+AMX_DECLARE_NATIVE(Native::TSC_GetChannelClients)
+{
+	if (params[3] <= 0)
+		return 0;
+
+	return SetAmxIdArray(amx, params[2], CServer::Get()->GetChannelClients(
+		static_cast<Channel::Id_t>(params[1]), static_cast<size_t>(params[3])));
+}
+
 
 
 //native TSC_GetClientIdByUid(uid[]);
@@ -15,8 +15,15 @@ namespace Native
 	//server functions
 	AMX_DECLARE_NATIVE(TSC_Connect);
 	AMX_DECLARE_NATIVE(TSC_Disconnect);
+	AMX_DECLARE_NATIVE(TSC_SetCacheFile);
 	AMX_DECLARE_NATIVE(TSC_ChangeNickname);
 	AMX_DECLARE_NATIVE(TSC_SendServerMessage);
+	AMX_DECLARE_NATIVE(TSC_SetPipelineDepth);
+	AMX_DECLARE_NATIVE(TSC_GetQueueWaitStats);
+	AMX_DECLARE_NATIVE(TSC_SetFloodControl);
+	AMX_DECLARE_NATIVE(TSC_GetFloodControlState);
+	AMX_DECLARE_NATIVE(TSC_SetCommandTimeout);
+	AMX_DECLARE_NATIVE(TSC_Cancel);
 
 
 	//data query functions
@@ -47,6 +54,12 @@ namespace Native
 	AMX_DECLARE_NATIVE(TSC_SetChannelOrderId);
 	AMX_DECLARE_NATIVE(TSC_GetChannelOrderId);
 	AMX_DECLARE_NATIVE(TSC_GetDefaultChannelId);
+	AMX_DECLARE_NATIVE(TSC_GetChannelChildCount);
+	AMX_DECLARE_NATIVE(TSC_GetChannelChildren);
+	AMX_DECLARE_NATIVE(TSC_GetChannelSiblings);
+	AMX_DECLARE_NATIVE(TSC_GetChannelSubtree);
+	AMX_DECLARE_NATIVE(TSC_GetChannelClientCount);
+	AMX_DECLARE_NATIVE(TSC_GetChannelClients);
 
 	
 	//client functions